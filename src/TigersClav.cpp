@@ -2,6 +2,7 @@
 #include "ImGuiFileDialog.h"
 #include "LogViewer.hpp"
 #include "data/MediaEncoder.hpp"
+#include "data/FrameCacheManager.hpp"
 #include "gui/ScoreBoardFactory.hpp"
 #include <filesystem>
 #include <chrono>
@@ -15,11 +16,18 @@ TigersClav::TigersClav()
  recordingAutoPlay_(false),
  recordingSliderHovered_(false),
  recordingIndex_(-1),
+ playbackSpeed_(1),
  exportScoreBoardCut_(false),
  exportScoreBoardGoals_(false),
  exportScoreBoardArchive_(false),
  exportUseHwDecoder_(true),
- exportUseHwEncoder_(true)
+ exportUseHwEncoder_(true),
+ exportSmartRender_(false),
+ exportFanOut_(true),
+ exportSegmentCache_(false),
+ exportSceneKeyframes_(true),
+ exportFragmented_(false),
+ frameCacheBudget_MB_(FrameCacheManager::getInstance().getBudget() >> 20)
 {
     glGenTextures(1, &scoreBoardTexture_);
     glGenTextures(1, &fieldVisualizerTexture_);
@@ -375,6 +383,11 @@ void TigersClav::drawProjectPanel()
     {
         ImGui::Checkbox("Use HW Decoder", &exportUseHwDecoder_);
         ImGui::Checkbox("Use HW Encoder", &exportUseHwEncoder_);
+        ImGui::Checkbox("Smart Render", &exportSmartRender_);
+        ImGui::Checkbox("Shared Decoding", &exportFanOut_);
+        ImGui::Checkbox("Reuse Segments", &exportSegmentCache_);
+        ImGui::Checkbox("Keyframes at Scenes", &exportSceneKeyframes_);
+        ImGui::Checkbox("Fragmented MP4", &exportFragmented_);
 
         ImGui::Separator();
 
@@ -484,11 +497,56 @@ void TigersClav::drawProjectPanel()
 
             pVideoProducer_->useHwDecoder(exportUseHwDecoder_);
             pVideoProducer_->useHwEncoder(exportUseHwEncoder_);
+            pVideoProducer_->useSmartRender(exportSmartRender_);
+            pVideoProducer_->useFanOut(exportFanOut_);
+            pVideoProducer_->useSegmentCache(exportSegmentCache_);
+            pVideoProducer_->useSceneKeyframes(exportSceneKeyframes_);
+            pVideoProducer_->useFragmentedOutput(exportFragmented_);
 
             pVideoProducer_->start();
         }
     }
 
+    ImGui::Spacing();
+    ImGui::Separator();
+    ImGui::Spacing();
+
+    if(ImGui::CollapsingHeader("Proxies##Header", ImGuiTreeNodeFlags_None))
+    {
+        if(pProxyGenerator_)
+        {
+            ImGui::Text("File: %s", pProxyGenerator_->getCurrentStep().c_str());
+            ImGui::ProgressBar(pProxyGenerator_->getProgress());
+
+            if(ImGui::Button("Abort##Proxies", ImVec2(200.0f, 0.0f)))
+                pProxyGenerator_->abort();
+
+            if(pProxyGenerator_->isDone())
+            {
+                pProxyGenerator_ = nullptr;
+
+                // switch previews over to the new proxies
+                for(const auto& pCam : pProject_->getCameras())
+                {
+                    for(const auto& pRecording : pCam->getVideos())
+                        pRecording->reloadVideo();
+                }
+            }
+        }
+        else if(ImGui::Button("Generate Proxies", ImVec2(200.0f, 0.0f)))
+        {
+            pProxyGenerator_ = std::make_unique<ProxyGenerator>();
+
+            for(const auto& pCam : pProject_->getCameras())
+            {
+                for(const auto& pRecording : pCam->getVideos())
+                    pProxyGenerator_->addSource(pRecording->pVideo_->getFilename());
+            }
+
+            pProxyGenerator_->start();
+        }
+    }
+
     if(pVideoProducer_)
         ImGui::OpenPopup("Rendering");
 
@@ -636,7 +694,7 @@ void TigersClav::drawSyncPanel()
             }
 
             ImVec2 btnScreenPos = ImGui::GetCursorScreenPos();
-            if(ImGui::Button(pRecording->getName().c_str(), ImVec2(pRecording->pVideo_->getDuration_s() * 1e9 * scaleX, heightCamera)))
+            if(ImGui::Button(pRecording->getName().c_str(), ImVec2(pRecording->getDuration_s() * 1e9 * scaleX, heightCamera)))
             {
                 recordingIndex_ = recordingIndex;
                 recordingAutoPlay_ = false;
@@ -652,7 +710,7 @@ void TigersClav::drawSyncPanel()
 
             if(pRecording->syncMarker_.has_value())
             {
-                float xPos = btnScreenPos.x + btnSize.x * (double)pRecording->syncMarker_->timestamp_ns/(pRecording->pVideo_->getDuration_s()*1e9);
+                float xPos = btnScreenPos.x + btnSize.x * (double)pRecording->syncMarker_->timestamp_ns/(pRecording->getDuration_s()*1e9);
                 float yPos = btnScreenPos.y - 1.0f;
                 ImGui::GetWindowDrawList()->AddLine(ImVec2(xPos, yPos), ImVec2(xPos, yPos+btnSize.y), 0xFF00FF00, 2.0f);
             }
@@ -720,7 +778,7 @@ void TigersClav::drawGameLogPanel()
         }
 
         ImGui::SameLine(0.0f, spacing);
-        ImGui::SetNextItemWidth(-78.0f);
+        ImGui::SetNextItemWidth(-134.0f);
         ImGui::SliderFloat("##GameLogTime", &gameLogTime_s_, 0.0f, tMax_s, "%.3fs", ImGuiSliderFlags_AlwaysClamp);
         gameLogSliderHovered_ = ImGui::IsItemHovered();
         if(ImGui::IsItemEdited())
@@ -748,7 +806,7 @@ void TigersClav::drawGameLogPanel()
 
         if(gameLogAutoPlay_)
         {
-            gameLogTime_s_ += ImGui::GetIO().DeltaTime;
+            gameLogTime_s_ += ImGui::GetIO().DeltaTime * playbackSpeed_;
             pGameLog->seekTo(gameLogTime_s_ * 1e9);
 
             if(ImGui::Button("Pause", ImVec2(50, 0)) || gameLogTime_s_*1e9 > pGameLog->getTotalDuration_ns())
@@ -764,6 +822,9 @@ void TigersClav::drawGameLogPanel()
             }
         }
 
+        ImGui::SameLine(0.0f, spacing);
+        drawPlaybackSpeedCombo();
+
         // Tracker source selection
         ImGui::AlignTextToFramePadding();
         ImGui::Text("Tracker Source: ");
@@ -967,7 +1028,7 @@ void TigersClav::drawVideoPanel()
         }
 
         ImGui::SameLine(0.0f, spacing);
-        ImGui::SetNextItemWidth(-78.0f);
+        ImGui::SetNextItemWidth(-134.0f);
         ImVec2 camTimePos = ImGui::GetCursorPos();
         ImVec2 camTimePosScreen = ImGui::GetCursorScreenPos();
         ImGui::SliderFloat("##CameraTime", &recordingTime_s_, 0.0f, tMax_s, "%.3fs", ImGuiSliderFlags_AlwaysClamp);
@@ -993,7 +1054,7 @@ void TigersClav::drawVideoPanel()
 
         if(recordingAutoPlay_)
         {
-            recordingTime_s_ += ImGui::GetIO().DeltaTime;
+            recordingTime_s_ += ImGui::GetIO().DeltaTime * playbackSpeed_;
 
             if(ImGui::Button("Pause", ImVec2(50, 0)))
             {
@@ -1008,6 +1069,9 @@ void TigersClav::drawVideoPanel()
             }
         }
 
+        ImGui::SameLine(0.0f, spacing);
+        drawPlaybackSpeedCombo();
+
         // Marker drawing
         if(pRecording->syncMarker_.has_value())
         {
@@ -1098,6 +1162,22 @@ void TigersClav::drawVideoPanel()
         ImGui::Text("Video Cache: %.3fs <=> %.3fs", cache.video_s[0], cache.video_s[1]);
         ImGui::Text("Audio Cache: %.3fs <=> %.3fs", cache.audio_s[0], cache.audio_s[1]);
 
+        const FrameCacheManager& cacheManager = FrameCacheManager::getInstance();
+
+        ImGui::Text("Frame Cache: %.1fMB / %.1fMB (source: %.1fMB, speed: %.2fx)", cacheManager.getUsedBytes() / 1048576.0f, cacheManager.getBudget() / 1048576.0f,
+                        pVideo->getCachedBytes() / 1048576.0f, pVideo->getPlaybackSpeed());
+        ImGui::Text("Packet Cache: %.1fMB", pVideo->getCachedPacketBytes() / 1048576.0f);
+
+        const FileReaderStats fileStats = pVideo->getFileStats();
+
+        ImGui::Text("File I/O: %.1fMB read, %.1fMB delivered, %llu seeks, %llu stalls (%.2fs)", fileStats.bytesRead / 1048576.0f, fileStats.bytesDelivered / 1048576.0f,
+                        (unsigned long long)fileStats.numSeeks, (unsigned long long)fileStats.numStalls, fileStats.stallTime_s);
+
+        ImGui::SetNextItemWidth(200.0f);
+        ImGui::SliderInt("Cache Budget [MB]", &frameCacheBudget_MB_, 256, 16384);
+        if(ImGui::IsItemDeactivatedAfterEdit())
+            FrameCacheManager::getInstance().setBudget((size_t)frameCacheBudget_MB_ << 20);
+
         // Play logic and finally frame drawing
         if(recordingTime_s_ > tMax_s)
         {
@@ -1105,6 +1185,9 @@ void TigersClav::drawVideoPanel()
             recordingAutoPlay_ = false;
         }
 
+        // fast playback only shows keyframes
+        pVideo->setTrickPlay(recordingAutoPlay_ && playbackSpeed_ >= 4);
+
         pVideo->seekTo(recordingTime_s_);
         auto pMediaFrame = pVideo->get();
         if(pMediaFrame)
@@ -1116,6 +1199,30 @@ void TigersClav::drawVideoPanel()
     ImGui::End();
 }
 
+void TigersClav::drawPlaybackSpeedCombo()
+{
+    const int speeds[] = { 1, 2, 4, 8, 16 };
+
+    std::string label = std::to_string(playbackSpeed_) + "x";
+
+    ImGui::SetNextItemWidth(50.0f);
+    if(ImGui::BeginCombo("##PlaybackSpeed", label.c_str(), ImGuiComboFlags_NoArrowButton))
+    {
+        for(int speed : speeds)
+        {
+            bool isSelected = speed == playbackSpeed_;
+
+            if(ImGui::Selectable((std::to_string(speed) + "x").c_str(), isSelected))
+                playbackSpeed_ = speed;
+
+            if(isSelected)
+                ImGui::SetItemDefaultFocus();
+        }
+
+        ImGui::EndCombo();
+    }
+}
+
 void TigersClav::createGamestateTextures()
 {
     BLImageData imgData = pScoreBoard_->getImageData();
@@ -9,6 +9,7 @@
 #include "util/ShaderProgram.hpp"
 #include "data/MediaSource.hpp"
 #include "model/VideoProducer.hpp"
+#include "model/ProxyGenerator.hpp"
 
 class TigersClav : public Application
 {
@@ -23,12 +24,14 @@ private:
     void drawVideoPanel();
     void drawProjectPanel();
     void drawSyncPanel();
+    void drawPlaybackSpeedCombo();
 
     std::unique_ptr<Project> pProject_;
     std::unique_ptr<ImageComposer> pImageComposer_;
     std::unique_ptr<AScoreBoard> pScoreBoard_;
     std::unique_ptr<FieldVisualizer> pFieldVisualizer_;
     std::unique_ptr<VideoProducer> pVideoProducer_;
+    std::unique_ptr<ProxyGenerator> pProxyGenerator_;
 
     std::string lastFileOpenPath_;
 
@@ -43,6 +46,8 @@ private:
 
     std::map<std::string, float> bufferedRecordingTimes_;
 
+    int playbackSpeed_; // shared by gamelog and video auto play
+
     char camNameBuf_[128];
     char markerNameBuf_[128];
 
@@ -55,4 +60,11 @@ private:
 
     bool exportUseHwDecoder_;
     bool exportUseHwEncoder_;
+    bool exportSmartRender_;
+    bool exportFanOut_;
+    bool exportSegmentCache_;
+    bool exportSceneKeyframes_;
+    bool exportFragmented_;
+
+    int frameCacheBudget_MB_;
 };
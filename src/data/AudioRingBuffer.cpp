@@ -0,0 +1,177 @@
+#include "AudioRingBuffer.hpp"
+#include <algorithm>
+#include <cstring>
+
+AudioRingBuffer::AudioRingBuffer()
+:format_(AV_SAMPLE_FMT_NONE),
+ channels_(0),
+ channelLayout_(0),
+ sampleRate_(0),
+ bytesPerSample_(0),
+ capacity_(0),
+ firstSample_(0),
+ endSample_(0)
+{
+}
+
+void AudioRingBuffer::setup(enum AVSampleFormat format, int channels, uint64_t channelLayout, int sampleRate, int capacity)
+{
+    format_ = av_get_planar_sample_fmt(format);
+    channels_ = channels;
+    channelLayout_ = channelLayout;
+    sampleRate_ = sampleRate;
+    bytesPerSample_ = av_get_bytes_per_sample(format_);
+    capacity_ = capacity;
+
+    planes_.assign(channels_, std::vector<uint8_t>((size_t)capacity_ * bytesPerSample_));
+
+    clear();
+}
+
+void AudioRingBuffer::clear()
+{
+    firstSample_ = 0;
+    endSample_ = 0;
+}
+
+int AudioRingBuffer::ringPos(int64_t sample) const
+{
+    return (int)(((sample % capacity_) + capacity_) % capacity_);
+}
+
+void AudioRingBuffer::write(const AVFrame* pFrame, int64_t firstSample)
+{
+    if(!isSetup())
+        return;
+
+    int count = pFrame->nb_samples;
+    int srcOffset = 0;
+
+    if(empty())
+    {
+        firstSample_ = firstSample;
+        endSample_ = firstSample;
+    }
+    else if(firstSample < endSample_)
+    {
+        // overlaps with stored data, keep what we have
+        const int skip = (int)std::min<int64_t>(count, endSample_ - firstSample);
+        srcOffset += skip;
+        count -= skip;
+    }
+    else if(firstSample > endSample_)
+    {
+        const int64_t gap = firstSample - endSample_;
+
+        if(gap >= capacity_)
+        {
+            firstSample_ = firstSample;
+            endSample_ = firstSample;
+        }
+        else
+        {
+            writeSilence(endSample_, (int)gap);
+        }
+    }
+
+    // only the newest samples fit
+    if(count > capacity_)
+    {
+        srcOffset += count - capacity_;
+        count = capacity_;
+    }
+
+    const bool srcPlanar = av_sample_fmt_is_planar((enum AVSampleFormat)pFrame->format);
+
+    int done = 0;
+    while(done < count)
+    {
+        const int pos = ringPos(endSample_ + done);
+        const int chunk = std::min(count - done, capacity_ - pos);
+
+        for(int ch = 0; ch < channels_; ch++)
+        {
+            uint8_t* pDst = planes_[ch].data() + (size_t)pos * bytesPerSample_;
+
+            if(srcPlanar)
+            {
+                memcpy(pDst, pFrame->extended_data[ch] + (size_t)(srcOffset + done) * bytesPerSample_, (size_t)chunk * bytesPerSample_);
+            }
+            else
+            {
+                // deinterleave packed formats
+                const uint8_t* pSrc = pFrame->extended_data[0] + ((size_t)(srcOffset + done) * channels_ + ch) * bytesPerSample_;
+
+                for(int i = 0; i < chunk; i++)
+                {
+                    memcpy(pDst, pSrc, bytesPerSample_);
+                    pDst += bytesPerSample_;
+                    pSrc += channels_ * bytesPerSample_;
+                }
+            }
+        }
+
+        done += chunk;
+    }
+
+    endSample_ += count;
+
+    if(endSample_ - firstSample_ > capacity_)
+        firstSample_ = endSample_ - capacity_;
+}
+
+void AudioRingBuffer::writeSilence(int64_t firstSample, int count)
+{
+    const uint8_t silence = (format_ == AV_SAMPLE_FMT_U8P) ? 0x80 : 0x00;
+
+    int done = 0;
+    while(done < count)
+    {
+        const int pos = ringPos(firstSample + done);
+        const int chunk = std::min(count - done, capacity_ - pos);
+
+        for(int ch = 0; ch < channels_; ch++)
+            memset(planes_[ch].data() + (size_t)pos * bytesPerSample_, silence, (size_t)chunk * bytesPerSample_);
+
+        done += chunk;
+    }
+
+    endSample_ = firstSample + count;
+
+    if(endSample_ - firstSample_ > capacity_)
+        firstSample_ = endSample_ - capacity_;
+}
+
+int AudioRingBuffer::read(AVFrame* pFrame, int64_t firstSample) const
+{
+    // pFrame must be allocated with our format and channel count, missing samples are silent
+    const int count = pFrame->nb_samples;
+
+    av_samples_set_silence(pFrame->extended_data, 0, count, channels_, format_);
+
+    if(!isSetup())
+        return 0;
+
+    const int64_t start = std::max(firstSample, firstSample_);
+    const int64_t end = std::min(firstSample + count, endSample_);
+
+    int done = 0;
+    while(start + done < end)
+    {
+        const int pos = ringPos(start + done);
+        const int chunk = (int)std::min<int64_t>(end - start - done, capacity_ - pos);
+        const size_t dstOffset = (size_t)(start - firstSample + done) * bytesPerSample_;
+
+        for(int ch = 0; ch < channels_; ch++)
+            memcpy(pFrame->extended_data[ch] + dstOffset, planes_[ch].data() + (size_t)pos * bytesPerSample_, (size_t)chunk * bytesPerSample_);
+
+        done += chunk;
+    }
+
+    return done;
+}
+
+void AudioRingBuffer::discardBefore(int64_t sample)
+{
+    firstSample_ = std::clamp(sample, firstSample_, endSample_);
+}
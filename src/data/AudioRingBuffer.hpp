@@ -0,0 +1,51 @@
+#pragma once
+
+#include "AVWrapper.hpp"
+
+extern "C" {
+#include <libavutil/samplefmt.h>
+}
+
+#include <vector>
+#include <cstdint>
+
+// Decoded audio of one stream, converted to planar format and stored in a
+// contiguous ring per channel. Samples are addressed by absolute sample number.
+class AudioRingBuffer
+{
+public:
+    AudioRingBuffer();
+
+    void setup(enum AVSampleFormat format, int channels, uint64_t channelLayout, int sampleRate, int capacity);
+    bool isSetup() const { return capacity_ > 0; }
+    void clear();
+
+    bool empty() const { return firstSample_ == endSample_; }
+    int64_t getFirstSample() const { return firstSample_; }
+    int64_t getEndSample() const { return endSample_; }
+
+    enum AVSampleFormat getFormat() const { return format_; }
+    int getChannels() const { return channels_; }
+    uint64_t getChannelLayout() const { return channelLayout_; }
+    int getSampleRate() const { return sampleRate_; }
+
+    void write(const AVFrame* pFrame, int64_t firstSample);
+    int read(AVFrame* pFrame, int64_t firstSample) const;
+    void discardBefore(int64_t sample);
+
+private:
+    int ringPos(int64_t sample) const;
+    void writeSilence(int64_t firstSample, int count);
+
+    std::vector<std::vector<uint8_t>> planes_;
+
+    enum AVSampleFormat format_;
+    int channels_;
+    uint64_t channelLayout_;
+    int sampleRate_;
+    int bytesPerSample_;
+    int capacity_;
+
+    int64_t firstSample_;
+    int64_t endSample_;
+};
@@ -0,0 +1,396 @@
+#include "FileReader.hpp"
+#include "util/easylogging++.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fcntl.h>
+
+#ifdef _WIN32
+#include <io.h>
+#include <malloc.h>
+#else
+#include <unistd.h>
+#endif
+
+static uint8_t* allocateAligned(size_t size, size_t alignment)
+{
+#ifdef _WIN32
+    return (uint8_t*)_aligned_malloc(size, alignment);
+#else
+    void* pData = nullptr;
+    if(posix_memalign(&pData, alignment, size))
+        return nullptr;
+
+    return (uint8_t*)pData;
+#endif
+}
+
+static void freeAligned(uint8_t* pData)
+{
+#ifdef _WIN32
+    _aligned_free(pData);
+#else
+    free(pData);
+#endif
+}
+
+FileReader::FileReader()
+:fd_(-1),
+ fileSize_(0),
+ directIO_(false),
+ sequentialHint_(false),
+ pAVIOContext_(0),
+ position_(0),
+ runReader_(false),
+ readAheadStart_(0),
+ readError_(false),
+ useCounter_(0),
+ bytesRead_(0),
+ bytesDelivered_(0),
+ numSeeks_(0),
+ numStalls_(0),
+ stallTime_s_(0.0)
+{
+}
+
+FileReader::~FileReader()
+{
+    stopReader();
+
+    if(pAVIOContext_)
+    {
+        av_freep(&pAVIOContext_->buffer);
+        avio_context_free(&pAVIOContext_);
+    }
+
+    if(fd_ >= 0)
+        ::close(fd_);
+}
+
+bool FileReader::open(const std::string& filename)
+{
+    std::error_code ec;
+    fileSize_ = std::filesystem::file_size(filename, ec);
+    if(ec)
+    {
+        LOG(ERROR) << "Could not get size of " << filename << ": " << ec.message();
+        return false;
+    }
+
+#ifdef _WIN32
+    fd_ = ::open(filename.c_str(), O_RDONLY | O_BINARY);
+#else
+    int flags = O_RDONLY;
+
+#ifdef O_DIRECT
+    if(directIO_)
+        flags |= O_DIRECT;
+#endif
+
+    fd_ = ::open(filename.c_str(), flags);
+    if(fd_ < 0 && directIO_)
+    {
+        LOG(WARNING) << "Direct I/O not supported for " << filename << ", using buffered I/O";
+
+        fd_ = ::open(filename.c_str(), O_RDONLY);
+    }
+
+#ifdef POSIX_FADV_SEQUENTIAL
+    if(fd_ >= 0 && sequentialHint_)
+        posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+#endif
+
+    if(fd_ < 0)
+    {
+        LOG(ERROR) << "Could not open " << filename << ": " << strerror(errno);
+        return false;
+    }
+
+    uint8_t* pBuffer = (uint8_t*)av_malloc(AVIO_BUFFER_SIZE);
+    if(!pBuffer)
+    {
+        LOG(ERROR) << "No memory for AVIO buffer";
+        return false;
+    }
+
+    pAVIOContext_ = avio_alloc_context(pBuffer, AVIO_BUFFER_SIZE, 0, this, &FileReader::avioRead, nullptr, &FileReader::avioSeek);
+    if(!pAVIOContext_)
+    {
+        av_free(pBuffer);
+        LOG(ERROR) << "Could not allocate AVIO context";
+        return false;
+    }
+
+    return startReader();
+}
+
+void FileReader::suspend()
+{
+    // must not be called while the demuxer reads
+    stopReader();
+}
+
+bool FileReader::startReader()
+{
+    for(size_t i = 0; i < NUM_BLOCKS; i++)
+    {
+        uint8_t* pData = allocateAligned(BLOCK_SIZE, BLOCK_ALIGNMENT);
+        if(!pData)
+        {
+            LOG(ERROR) << "No memory for file read buffers";
+            stopReader();
+            return false;
+        }
+
+        blocks_.push_back(Block{ pData, -1, 0, 0 });
+    }
+
+    readError_ = false;
+    runReader_ = true;
+    readerThread_ = std::thread(&FileReader::reader, this);
+
+    return true;
+}
+
+void FileReader::stopReader()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        runReader_ = false;
+    }
+
+    readerCv_.notify_all();
+    dataCv_.notify_all();
+
+    if(readerThread_.joinable())
+        readerThread_.join();
+
+    for(auto& block : blocks_)
+        freeAligned(block.pData);
+
+    blocks_.clear();
+}
+
+FileReaderStats FileReader::getStats() const
+{
+    return FileReaderStats{ bytesRead_, bytesDelivered_, numSeeks_, numStalls_, stallTime_s_ };
+}
+
+int FileReader::avioRead(void* pOpaque, uint8_t* pBuf, int bufSize)
+{
+    return static_cast<FileReader*>(pOpaque)->read(pBuf, bufSize);
+}
+
+int64_t FileReader::avioSeek(void* pOpaque, int64_t offset, int whence)
+{
+    return static_cast<FileReader*>(pOpaque)->seek(offset, whence);
+}
+
+int FileReader::read(uint8_t* pBuf, int bufSize)
+{
+    if(position_ >= fileSize_)
+        return AVERROR_EOF;
+
+    // suspended readers are started again by the demuxing thread
+    if(!readerThread_.joinable() && !startReader())
+        return AVERROR(ENOMEM);
+
+    const int64_t blockOffset = position_ - position_ % BLOCK_SIZE;
+
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    if(readAheadStart_ != blockOffset)
+    {
+        readAheadStart_ = blockOffset;
+        readerCv_.notify_one();
+    }
+
+    Block* pBlock = findBlock(blockOffset);
+    if(!pBlock)
+    {
+        const auto tStart = std::chrono::steady_clock::now();
+
+        dataCv_.wait(lock, [&]() { pBlock = findBlock(blockOffset); return pBlock || readError_ || !runReader_; });
+
+        numStalls_++;
+        stallTime_s_ = stallTime_s_ + std::chrono::duration<double>(std::chrono::steady_clock::now() - tStart).count();
+
+        if(!pBlock)
+            return AVERROR(EIO);
+    }
+
+    pBlock->lastUse = ++useCounter_;
+
+    const size_t blockPos = position_ - blockOffset;
+    if(blockPos >= pBlock->size)
+        return AVERROR_EOF;
+
+    const size_t bytes = std::min((size_t)bufSize, pBlock->size - blockPos);
+
+    memcpy(pBuf, pBlock->pData + blockPos, bytes);
+
+    position_ += bytes;
+    bytesDelivered_ += bytes;
+
+    return (int)bytes;
+}
+
+int64_t FileReader::seek(int64_t offset, int whence)
+{
+    int64_t position;
+
+    switch(whence & ~AVSEEK_FORCE)
+    {
+        case AVSEEK_SIZE: return fileSize_;
+        case SEEK_SET: position = offset; break;
+        case SEEK_CUR: position = position_ + offset; break;
+        case SEEK_END: position = fileSize_ + offset; break;
+        default: return AVERROR(EINVAL);
+    }
+
+    if(position < 0)
+        return AVERROR(EINVAL);
+
+    if(position != position_)
+    {
+        numSeeks_++;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            readError_ = false;
+        }
+
+        readerCv_.notify_one();
+    }
+
+    position_ = position;
+
+    return position_;
+}
+
+FileReader::Block* FileReader::findBlock(int64_t offset)
+{
+    // mutex_ must be held by caller
+    for(auto& block : blocks_)
+    {
+        if(block.offset == offset)
+            return &block;
+    }
+
+    return nullptr;
+}
+
+FileReader::Block* FileReader::findVictim()
+{
+    // mutex_ must be held by caller, blocks inside the read ahead window are kept
+    const int64_t windowEnd = readAheadStart_ + READ_AHEAD_BLOCKS * BLOCK_SIZE;
+
+    Block* pVictim = nullptr;
+
+    for(auto& block : blocks_)
+    {
+        if(block.offset < 0)
+            return &block;
+
+        if(block.offset >= readAheadStart_ && block.offset < windowEnd)
+            continue;
+
+        if(!pVictim || block.lastUse < pVictim->lastUse)
+            pVictim = &block;
+    }
+
+    return pVictim;
+}
+
+bool FileReader::readBlock(int64_t offset, uint8_t* pData, size_t& size)
+{
+    size = 0;
+
+    while(size < BLOCK_SIZE)
+    {
+#ifdef _WIN32
+        if(_lseeki64(fd_, offset + size, SEEK_SET) < 0)
+            return false;
+
+        const int result = _read(fd_, pData + size, BLOCK_SIZE - size);
+#else
+        const ssize_t result = pread(fd_, pData + size, BLOCK_SIZE - size, offset + size);
+#endif
+        if(result < 0)
+        {
+            if(errno == EINTR)
+                continue;
+
+            return false;
+        }
+
+        if(result == 0)
+            break;
+
+        size += result;
+    }
+
+    return true;
+}
+
+void FileReader::reader()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    while(runReader_)
+    {
+        // next missing block in front of the demuxer
+        int64_t offset = -1;
+
+        for(size_t i = 0; i < READ_AHEAD_BLOCKS && !readError_; i++)
+        {
+            const int64_t blockOffset = readAheadStart_ + i * BLOCK_SIZE;
+            if(blockOffset >= fileSize_)
+                break;
+
+            if(!findBlock(blockOffset))
+            {
+                offset = blockOffset;
+                break;
+            }
+        }
+
+        Block* pBlock = offset < 0 ? nullptr : findVictim();
+        if(!pBlock)
+        {
+            readerCv_.wait(lock);
+            continue;
+        }
+
+        pBlock->offset = -1;
+
+        lock.unlock();
+
+        size_t size;
+        const bool success = readBlock(offset, pBlock->pData, size);
+
+        lock.lock();
+
+        if(!success)
+        {
+            LOG(ERROR) << "Read error at offset " << offset << ": " << strerror(errno);
+
+            readError_ = true;
+        }
+        else
+        {
+            pBlock->offset = offset;
+            pBlock->size = size;
+            pBlock->lastUse = ++useCounter_;
+
+            bytesRead_ += size;
+        }
+
+        dataCv_.notify_all();
+    }
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "AVWrapper.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct FileReaderStats
+{
+    uint64_t bytesRead;
+    uint64_t bytesDelivered;
+    uint64_t numSeeks;
+    uint64_t numStalls;
+    double stallTime_s;
+};
+
+// Demuxer input via a custom AVIOContext. A separate thread reads the file in
+// large aligned blocks ahead of the current position, so decoding threads
+// rarely have to wait for slow (network) storage.
+class FileReader
+{
+public:
+    FileReader();
+    ~FileReader();
+
+    // must be set before open
+    void useDirectIO(bool enable) { directIO_ = enable; }
+    void useSequentialHint(bool enable) { sequentialHint_ = enable; }
+
+    bool open(const std::string& filename);
+    AVIOContext* getAVIOContext() { return pAVIOContext_; }
+
+    // stops the read ahead thread and frees its blocks, the next read starts them again
+    void suspend();
+
+    FileReaderStats getStats() const;
+
+    static constexpr size_t BLOCK_SIZE = 1024*1024;
+    static constexpr size_t BLOCK_ALIGNMENT = 4096;
+    static constexpr size_t NUM_BLOCKS = 16;
+    static constexpr size_t READ_AHEAD_BLOCKS = 12;
+    static constexpr int AVIO_BUFFER_SIZE = 256*1024;
+
+private:
+    struct Block
+    {
+        uint8_t* pData;
+        int64_t offset;
+        size_t size;
+        uint64_t lastUse;
+    };
+
+    static int avioRead(void* pOpaque, uint8_t* pBuf, int bufSize);
+    static int64_t avioSeek(void* pOpaque, int64_t offset, int whence);
+
+    int read(uint8_t* pBuf, int bufSize);
+    int64_t seek(int64_t offset, int whence);
+
+    bool startReader();
+    void stopReader();
+
+    Block* findBlock(int64_t offset);
+    Block* findVictim();
+    bool readBlock(int64_t offset, uint8_t* pData, size_t& size);
+    void reader();
+
+    int fd_;
+    int64_t fileSize_;
+    bool directIO_;
+    bool sequentialHint_;
+
+    AVIOContext* pAVIOContext_;
+
+    // position is only used from the demuxing thread
+    int64_t position_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable readerCv_;
+    std::condition_variable dataCv_;
+    std::thread readerThread_;
+    bool runReader_;
+
+    std::vector<Block> blocks_;
+    int64_t readAheadStart_;
+    bool readError_;
+    uint64_t useCounter_;
+
+    std::atomic<uint64_t> bytesRead_;
+    std::atomic<uint64_t> bytesDelivered_;
+    std::atomic<uint64_t> numSeeks_;
+    std::atomic<uint64_t> numStalls_;
+    std::atomic<double> stallTime_s_;
+};
@@ -0,0 +1,257 @@
+#include "FileWriter.hpp"
+#include "util/easylogging++.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+FileWriter::FileWriter()
+:fd_(-1),
+ preallocated_(false),
+ pAVIOContext_(0),
+ position_(0),
+ fileSize_(0),
+ runWriter_(false),
+ queuedBytes_(0),
+ writeError_(false),
+ bytesWritten_(0),
+ numStalls_(0),
+ stallTime_s_(0.0),
+ maxQueuedBytes_(0)
+{
+}
+
+FileWriter::~FileWriter()
+{
+    close();
+}
+
+bool FileWriter::open(const std::string& filename, uint64_t preallocateBytes)
+{
+#ifdef _WIN32
+    fd_ = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0644);
+#else
+    fd_ = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#endif
+
+    if(fd_ < 0)
+    {
+        LOG(ERROR) << "Could not open " << filename << " for writing: " << strerror(errno);
+        return false;
+    }
+
+#ifdef __linux__
+    // reserve space up front to avoid fragmentation, the file is truncated to its real size on close
+    if(preallocateBytes > 0)
+    {
+        const int result = posix_fallocate(fd_, 0, preallocateBytes);
+        if(result)
+            LOG(WARNING) << "Preallocating " << (preallocateBytes >> 20) << "MB failed: " << strerror(result);
+        else
+            preallocated_ = true;
+    }
+#endif
+
+    uint8_t* pBuffer = (uint8_t*)av_malloc(AVIO_BUFFER_SIZE);
+    if(!pBuffer)
+    {
+        LOG(ERROR) << "No memory for AVIO buffer";
+        return false;
+    }
+
+    pAVIOContext_ = avio_alloc_context(pBuffer, AVIO_BUFFER_SIZE, 1, this, nullptr, &FileWriter::avioWrite, &FileWriter::avioSeek);
+    if(!pAVIOContext_)
+    {
+        av_free(pBuffer);
+        LOG(ERROR) << "Could not allocate AVIO context";
+        return false;
+    }
+
+    runWriter_ = true;
+    writerThread_ = std::thread(&FileWriter::writer, this);
+
+    return true;
+}
+
+int FileWriter::close()
+{
+    if(pAVIOContext_)
+        avio_flush(pAVIOContext_);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        runWriter_ = false;
+    }
+
+    writerCv_.notify_all();
+
+    // writer thread finishes the queue before it stops
+    if(writerThread_.joinable())
+        writerThread_.join();
+
+    if(pAVIOContext_)
+    {
+        av_freep(&pAVIOContext_->buffer);
+        avio_context_free(&pAVIOContext_);
+    }
+
+    if(fd_ < 0)
+        return 0;
+
+#ifndef _WIN32
+    if(preallocated_ && ftruncate(fd_, fileSize_))
+    {
+        LOG(ERROR) << "Truncating output file failed: " << strerror(errno);
+        writeError_ = true;
+    }
+#endif
+
+    ::close(fd_);
+    fd_ = -1;
+
+    return writeError_ ? AVERROR(EIO) : 0;
+}
+
+FileWriterStats FileWriter::getStats() const
+{
+    return FileWriterStats{ bytesWritten_, numStalls_, stallTime_s_, maxQueuedBytes_ };
+}
+
+int FileWriter::avioWrite(void* pOpaque, uint8_t* pBuf, int bufSize)
+{
+    return static_cast<FileWriter*>(pOpaque)->write(pBuf, bufSize);
+}
+
+int64_t FileWriter::avioSeek(void* pOpaque, int64_t offset, int whence)
+{
+    return static_cast<FileWriter*>(pOpaque)->seek(offset, whence);
+}
+
+int FileWriter::write(const uint8_t* pBuf, int bufSize)
+{
+    Chunk chunk { position_, std::vector<uint8_t>(pBuf, pBuf + bufSize) };
+
+    position_ += bufSize;
+    fileSize_ = std::max(fileSize_, position_);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    if(writeError_)
+        return AVERROR(EIO);
+
+    if(queuedBytes_ + bufSize > MAX_QUEUED_BYTES)
+    {
+        const auto tStart = std::chrono::steady_clock::now();
+
+        queueCv_.wait(lock, [&]() { return queuedBytes_ + bufSize <= MAX_QUEUED_BYTES || queue_.empty() || writeError_; });
+
+        numStalls_++;
+        stallTime_s_ = stallTime_s_ + std::chrono::duration<double>(std::chrono::steady_clock::now() - tStart).count();
+
+        if(writeError_)
+            return AVERROR(EIO);
+    }
+
+    queue_.push_back(std::move(chunk));
+    queuedBytes_ += bufSize;
+    maxQueuedBytes_ = std::max<size_t>(maxQueuedBytes_, queuedBytes_);
+
+    writerCv_.notify_one();
+
+    return bufSize;
+}
+
+int64_t FileWriter::seek(int64_t offset, int whence)
+{
+    int64_t position;
+
+    switch(whence & ~AVSEEK_FORCE)
+    {
+        case AVSEEK_SIZE: return fileSize_;
+        case SEEK_SET: position = offset; break;
+        case SEEK_CUR: position = position_ + offset; break;
+        case SEEK_END: position = fileSize_ + offset; break;
+        default: return AVERROR(EINVAL);
+    }
+
+    if(position < 0)
+        return AVERROR(EINVAL);
+
+    // chunks carry their offset, nothing to do on the file itself
+    position_ = position;
+
+    return position_;
+}
+
+bool FileWriter::writeChunk(const Chunk& chunk)
+{
+    size_t written = 0;
+
+    while(written < chunk.data.size())
+    {
+#ifdef _WIN32
+        if(_lseeki64(fd_, chunk.offset + written, SEEK_SET) < 0)
+            return false;
+
+        const int result = _write(fd_, chunk.data.data() + written, chunk.data.size() - written);
+#else
+        const ssize_t result = pwrite(fd_, chunk.data.data() + written, chunk.data.size() - written, chunk.offset + written);
+#endif
+        if(result < 0)
+        {
+            if(errno == EINTR)
+                continue;
+
+            return false;
+        }
+
+        written += result;
+    }
+
+    return true;
+}
+
+void FileWriter::writer()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    while(1)
+    {
+        writerCv_.wait(lock, [&]() { return !queue_.empty() || !runWriter_; });
+
+        if(queue_.empty())
+            break;
+
+        Chunk chunk = std::move(queue_.front());
+        queue_.pop_front();
+
+        lock.unlock();
+
+        const bool success = writeChunk(chunk);
+
+        lock.lock();
+
+        queuedBytes_ -= chunk.data.size();
+
+        if(success)
+        {
+            bytesWritten_ += chunk.data.size();
+        }
+        else if(!writeError_)
+        {
+            LOG(ERROR) << "Write error at offset " << chunk.offset << ": " << strerror(errno);
+
+            writeError_ = true;
+        }
+
+        queueCv_.notify_all();
+    }
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "AVWrapper.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct FileWriterStats
+{
+    uint64_t bytesWritten;
+    uint64_t numStalls;
+    double stallTime_s;
+    size_t maxQueuedBytes;
+};
+
+// Muxer output via a custom AVIOContext. Data is handed over to a separate
+// thread in large chunks and written at its file offset, so encoding only
+// waits for the disk if the queue is full.
+class FileWriter
+{
+public:
+    FileWriter();
+    ~FileWriter();
+
+    bool open(const std::string& filename, uint64_t preallocateBytes = 0);
+    int close();
+
+    AVIOContext* getAVIOContext() { return pAVIOContext_; }
+
+    FileWriterStats getStats() const;
+
+    static constexpr int AVIO_BUFFER_SIZE = 4*1024*1024;
+    static constexpr size_t MAX_QUEUED_BYTES = 64*1024*1024;
+
+private:
+    struct Chunk
+    {
+        int64_t offset;
+        std::vector<uint8_t> data;
+    };
+
+    static int avioWrite(void* pOpaque, uint8_t* pBuf, int bufSize);
+    static int64_t avioSeek(void* pOpaque, int64_t offset, int whence);
+
+    int write(const uint8_t* pBuf, int bufSize);
+    int64_t seek(int64_t offset, int whence);
+
+    bool writeChunk(const Chunk& chunk);
+    void writer();
+
+    int fd_;
+    bool preallocated_;
+
+    AVIOContext* pAVIOContext_;
+
+    // only used from the muxing thread
+    int64_t position_;
+    int64_t fileSize_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable writerCv_;
+    std::condition_variable queueCv_;
+    std::thread writerThread_;
+    bool runWriter_;
+
+    std::deque<Chunk> queue_;
+    size_t queuedBytes_;
+    bool writeError_;
+
+    std::atomic<uint64_t> bytesWritten_;
+    std::atomic<uint64_t> numStalls_;
+    std::atomic<double> stallTime_s_;
+    std::atomic<size_t> maxQueuedBytes_;
+};
@@ -0,0 +1,178 @@
+#include "FrameCacheManager.hpp"
+#include "MediaSource.hpp"
+#include "util/easylogging++.h"
+
+extern "C" {
+#include <libavutil/imgutils.h>
+}
+
+FrameCacheManager& FrameCacheManager::getInstance()
+{
+    static FrameCacheManager instance;
+    return instance;
+}
+
+FrameCacheManager::FrameCacheManager()
+:budget_(DEFAULT_BUDGET),
+ usedBytes_(0)
+{
+}
+
+void FrameCacheManager::setBudget(size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    budget_ = bytes;
+
+    LOG(INFO) << "Frame cache budget set to " << (bytes >> 20) << "MB";
+
+    evict(nullptr, 0);
+}
+
+size_t FrameCacheManager::getUsedBytes() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    return usedBytes_;
+}
+
+size_t FrameCacheManager::getUsedBytes(const MediaSource* pSource) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    const auto iter = sources_.find(const_cast<MediaSource*>(pSource));
+    if(iter == sources_.end())
+        return 0;
+
+    return iter->second.usedBytes;
+}
+
+size_t FrameCacheManager::getNumActiveSources() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // sources accessed recently are considered to compete for the budget
+    const auto tActive = std::chrono::steady_clock::now() - std::chrono::seconds(2);
+
+    size_t numActive = 0;
+    for(const auto& entry : sources_)
+    {
+        if(entry.second.lastAccess > tActive)
+            numActive++;
+    }
+
+    return numActive;
+}
+
+void FrameCacheManager::registerSource(MediaSource* pSource)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    sources_[pSource] = SourceEntry{ 0, std::chrono::steady_clock::now(), pSource->getUsage() == MediaSource::Usage::PREVIEW };
+}
+
+void FrameCacheManager::unregisterSource(MediaSource* pSource)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    const auto iter = sources_.find(pSource);
+    if(iter == sources_.end())
+        return;
+
+    usedBytes_ -= iter->second.usedBytes;
+    sources_.erase(iter);
+}
+
+void FrameCacheManager::touch(MediaSource* pSource)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    const auto iter = sources_.find(pSource);
+    if(iter != sources_.end())
+        iter->second.lastAccess = std::chrono::steady_clock::now();
+}
+
+bool FrameCacheManager::reserve(MediaSource* pSource, size_t bytes, bool force)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    const auto iter = sources_.find(pSource);
+    if(iter == sources_.end())
+        return false;
+
+    if(usedBytes_ + bytes > budget_)
+        evict(pSource, bytes);
+
+    if(usedBytes_ + bytes > budget_ && !force)
+        return false;
+
+    iter->second.usedBytes += bytes;
+    usedBytes_ += bytes;
+
+    return true;
+}
+
+void FrameCacheManager::release(MediaSource* pSource, size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    const auto iter = sources_.find(pSource);
+    if(iter == sources_.end())
+        return;
+
+    bytes = std::min(bytes, iter->second.usedBytes);
+
+    iter->second.usedBytes -= bytes;
+    usedBytes_ -= bytes;
+}
+
+void FrameCacheManager::evict(MediaSource* pRequester, size_t bytes)
+{
+    // mutex_ must be held by caller
+    while(usedBytes_ + bytes > budget_)
+    {
+        auto victim = sources_.end();
+
+        for(auto iter = sources_.begin(); iter != sources_.end(); iter++)
+        {
+            if(iter->first == pRequester || iter->second.usedBytes == 0 || !iter->second.evictable)
+                continue;
+
+            if(victim == sources_.end() || iter->second.lastAccess < victim->second.lastAccess)
+                victim = iter;
+        }
+
+        if(victim == sources_.end())
+            break;
+
+        LOG(TRACE) << "Evicting frame cache of " << victim->first->getFilename() << " (" << (victim->second.usedBytes >> 20) << "MB)";
+
+        size_t freedBytes = std::min(victim->first->evictCache(), victim->second.usedBytes);
+
+        victim->second.usedBytes -= freedBytes;
+        usedBytes_ -= freedBytes;
+
+        if(freedBytes == 0)
+            break;
+    }
+}
+
+size_t FrameCacheManager::getFrameSize(const AVFrame* pFrame)
+{
+    size_t size = 0;
+
+    for(int i = 0; i < AV_NUM_DATA_POINTERS; i++)
+    {
+        if(pFrame->buf[i])
+            size += pFrame->buf[i]->size;
+    }
+
+    if(size == 0 && pFrame->width > 0)
+    {
+        int imageSize = av_image_get_buffer_size((enum AVPixelFormat)pFrame->format, pFrame->width, pFrame->height, 1);
+        if(imageSize > 0)
+            size = imageSize;
+    }
+
+    return size;
+}
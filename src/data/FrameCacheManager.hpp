@@ -0,0 +1,58 @@
+#pragma once
+
+#include "AVWrapper.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <map>
+#include <mutex>
+
+class MediaSource;
+
+// Process-wide bookkeeping of decoded frames held by all MediaSources.
+// Sources reserve memory before caching a frame. If the budget is exceeded the
+// least recently used preview sources are asked to drop their caches. Export
+// sources count towards the budget but are never evicted, their look-ahead is
+// needed right away.
+class FrameCacheManager
+{
+public:
+    static FrameCacheManager& getInstance();
+
+    void setBudget(size_t bytes);
+    size_t getBudget() const { return budget_; }
+
+    size_t getUsedBytes() const;
+    size_t getUsedBytes(const MediaSource* pSource) const;
+    size_t getNumActiveSources() const;
+
+    void registerSource(MediaSource* pSource);
+    void unregisterSource(MediaSource* pSource);
+
+    void touch(MediaSource* pSource);
+    bool reserve(MediaSource* pSource, size_t bytes, bool force = false);
+    void release(MediaSource* pSource, size_t bytes);
+
+    static size_t getFrameSize(const AVFrame* pFrame);
+
+    static constexpr size_t DEFAULT_BUDGET = 2048ULL*1024*1024;
+
+private:
+    FrameCacheManager();
+
+    void evict(MediaSource* pRequester, size_t bytes);
+
+    struct SourceEntry
+    {
+        size_t usedBytes;
+        std::chrono::steady_clock::time_point lastAccess;
+        bool evictable;
+    };
+
+    mutable std::mutex mutex_;
+    std::map<MediaSource*, SourceEntry> sources_;
+
+    std::atomic<size_t> budget_;
+    size_t usedBytes_;
+};
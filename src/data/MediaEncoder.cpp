@@ -1,6 +1,8 @@
 #include "MediaEncoder.hpp"
 #include "util/easylogging++.h"
+#include <algorithm>
 #include <chrono>
+#include <cstring>
 
 extern "C" {
 #include <libavutil/opt.h>
@@ -18,12 +20,31 @@ MediaEncoder::MediaEncoder(std::string filename, bool useHwEncoder)
  pAudioCodec_(0),
  pAudioCodecContext_(0),
  pResampler_(0),
+ pAudioFifo_(0),
  curVideoPts_(0),
  curAudioPts_(0),
- useHwEncoder_(useHwEncoder)
+ lastVideoDts_(AV_NOPTS_VALUE),
+ useHwEncoder_(useHwEncoder),
+ gopSize_(0),
+ fastDecode_(false),
+ expectedDuration_s_(0.0),
+ fragmented_(false),
+ fillerFrames_(0),
+ pendingFillerEndPts_(0),
+ forceKeyframe_(false),
+ prependHeaders_(false),
+ nextKeyframe_(0)
 {
 }
 
+void MediaEncoder::setKeyframeTimes(std::vector<double> times_s)
+{
+    std::sort(times_s.begin(), times_s.end());
+
+    keyframeTimes_s_ = times_s;
+    nextKeyframe_ = 0;
+}
+
 MediaEncoder::~MediaEncoder()
 {
     close();
@@ -91,8 +112,23 @@ bool MediaEncoder::initialize(std::shared_ptr<const MediaFrame> pFrame)
         {
             av_opt_set(pVideoCodecContext_->priv_data, "preset", "faster", 0);
             av_opt_set(pVideoCodecContext_->priv_data, "movflags", "faststart", 0);
+
+            if(fastDecode_)
+                av_opt_set(pVideoCodecContext_->priv_data, "tune", "fastdecode", 0);
         }
 
+        // frames forced to be intra after a filler must not reference anything before
+        av_opt_set(pVideoCodecContext_->priv_data, "forced-idr", "1", 0);
+
+        if(gopSize_ > 0)
+        {
+            pVideoCodecContext_->gop_size = gopSize_;
+            pVideoCodecContext_->keyint_min = gopSize_;
+        }
+
+        if(fastDecode_)
+            pVideoCodecContext_->max_b_frames = 0;
+
         pVideoCodecContext_->width = pVideo->width;
         pVideoCodecContext_->height = pVideo->height;
         pVideoCodecContext_->sample_aspect_ratio = av_make_q(1, 1);
@@ -144,6 +180,13 @@ bool MediaEncoder::initialize(std::shared_ptr<const MediaFrame> pFrame)
             }
         }
 
+        pAudioFifo_ = av_audio_fifo_alloc(AV_SAMPLE_FMT_FLTP, pAudio->channels, pAudio->sample_rate);
+        if(!pAudioFifo_)
+        {
+            LOG(ERROR) << "No memory for audio FIFO";
+            return false;
+        }
+
         pAudioStream_ = avformat_new_stream(pFormatContext_, NULL);
         if(!pAudioStream_)
         {
@@ -194,18 +237,39 @@ bool MediaEncoder::initialize(std::shared_ptr<const MediaFrame> pFrame)
 
     if(!(pFormatContext_->oformat->flags & AVFMT_NOFILE))
     {
-        result = avio_open(&pFormatContext_->pb, filename_.c_str(), AVIO_FLAG_WRITE);
-        if(result < 0)
+        // reserve space for the expected output size
+        uint64_t preallocateBytes = 0;
+
+        // zeros behind the last fragment would be read as a box extending to the end of the file
+        if(expectedDuration_s_ > 0.0 && !fragmented_)
         {
-            LOG(ERROR) << "Opening AVIOContext failed: " << err2str(result);
+            int64_t bitRate = pVideoCodecContext_ ? pVideoCodecContext_->bit_rate : 0;
+            if(pAudioCodecContext_)
+                bitRate += pAudioCodecContext_->bit_rate;
+
+            preallocateBytes = (uint64_t)(bitRate / 8 * expectedDuration_s_);
+        }
+
+        // packets are written by a separate thread, encoding does not wait for the disk
+        pFileWriter_ = std::make_unique<FileWriter>();
+        if(!pFileWriter_->open(filename_, preallocateBytes))
+        {
+            LOG(ERROR) << "Opening output file failed: " << filename_;
             return false;
         }
+
+        pFormatContext_->pb = pFileWriter_->getAVIOContext();
     }
 
     if(debug_)
         av_dump_format(pFormatContext_, 0, filename_.c_str(), 1);
 
-    result = avformat_write_header(pFormatContext_, NULL);
+    AVDictionary* pOptions = nullptr;
+    if(fragmented_)
+        av_dict_set(&pOptions, "movflags", FRAGMENTED_MOVFLAGS, 0);
+
+    result = avformat_write_header(pFormatContext_, &pOptions);
+    av_dict_free(&pOptions);
     if(result < 0)
     {
         LOG(ERROR) << "Writing file header failed: " << err2str(result);
@@ -236,9 +300,20 @@ void MediaEncoder::close()
         {
             LOG(INFO) << "File trailer written.";
 
-            if(!(pFormatContext_->oformat->flags & AVFMT_NOFILE))
+            if(pFileWriter_)
             {
-                avio_close(pFormatContext_->pb);
+                result = pFileWriter_->close();
+                if(result < 0)
+                {
+                    LOG(ERROR) << "Writing output file failed: " << err2str(result);
+                }
+                else
+                {
+                    const FileWriterStats stats = pFileWriter_->getStats();
+
+                    LOG(INFO) << "Output written: " << (stats.bytesWritten >> 20) << "MB, max queued: " << (stats.maxQueuedBytes >> 20)
+                              << "MB, stalls: " << stats.numStalls << " (" << stats.stallTime_s << "s)";
+                }
             }
         }
     }
@@ -246,12 +321,22 @@ void MediaEncoder::close()
     if(pResampler_)
         swr_free(&pResampler_);
 
+    if(pAudioFifo_)
+        av_audio_fifo_free(pAudioFifo_);
+
     if(pFormatContext_)
         avformat_free_context(pFormatContext_);
 
+    pFileWriter_.reset();
+
     if(pVideoCodecContext_)
         avcodec_free_context(&pVideoCodecContext_);
 
+    fillerPackets_.clear();
+    pendingFiller_.clear();
+    fillerFrames_ = 0;
+    lastVideoDts_ = AV_NOPTS_VALUE;
+
     if(pAudioCodecContext_)
         avcodec_free_context(&pAudioCodecContext_);
 
@@ -263,6 +348,7 @@ void MediaEncoder::close()
     pAudioStream_ = 0;
     pAudioCodec_ = 0;
     pAudioCodecContext_ = 0;
+    pAudioFifo_ = 0;
 }
 
 int MediaEncoder::sendVideoFrame(const AVFrame* pVideo)
@@ -287,6 +373,20 @@ int MediaEncoder::sendVideoFrame(const AVFrame* pVideo)
     pEnc->pts = curVideoPts_;
     curVideoPts_ += videoPtsInc;
 
+    // the first frame reaching a requested time, points within fillers are covered by the keyframe after them
+    const double tFrameEnd_s = curVideoPts_ * av_q2d(pVideoStream_->time_base);
+    while(nextKeyframe_ < keyframeTimes_s_.size() && keyframeTimes_s_[nextKeyframe_] < tFrameEnd_s)
+    {
+        forceKeyframe_ = true;
+        nextKeyframe_++;
+    }
+
+    if(forceKeyframe_)
+    {
+        pEnc->pict_type = AV_PICTURE_TYPE_I;
+        forceKeyframe_ = false;
+    }
+
     LOG_IF(debug_, INFO) << "Encoding video frame. PTS: " << pEnc->pts;
 
     result = avcodec_send_frame(pVideoCodecContext_, pEnc);
@@ -336,13 +436,24 @@ int MediaEncoder::receiveVideoPackets()
 
         LOG_IF(debug_, INFO) << "   Encoded video frame. PTS: " << packet->pts << ", DTS: " << packet->dts << ", dur: " << packet->duration << ", stream: " << packet->stream_index;
 
-        result = av_interleaved_write_frame(pFormatContext_, packet);
-        if(result < 0)
+        // all frames before a filler have been returned, it goes in front of this one
+        if(!pendingFiller_.empty() && packet->pts >= pendingFillerEndPts_)
         {
-            LOG(ERROR) << "Error while writing frame data: " << err2str(result);
-            return -1;
+            if(writePendingFiller() < 0)
+                return -1;
+
+            prependHeaders_ = true;
         }
 
+        if(prependHeaders_ && (packet->flags & AV_PKT_FLAG_KEY))
+        {
+            prependHeaders(packet, pVideoCodecContext_);
+            prependHeaders_ = false;
+        }
+
+        if(writeVideoPacket(packet) < 0)
+            return -1;
+
         av_packet_unref(packet);
 
         auto tWrite = std::chrono::high_resolution_clock::now();
@@ -352,111 +463,342 @@ int MediaEncoder::receiveVideoPackets()
     return 0;
 }
 
-int MediaEncoder::sendAudioFrameFromBuffer(bool flush)
+int MediaEncoder::writeVideoPacket(AVPacket* pPacket)
 {
     int result;
-    int audioPtsInc = pAudioStream_->time_base.den / (pAudioStream_->time_base.num * pAudioCodecContext_->sample_rate);
 
-    auto tStart = std::chrono::high_resolution_clock::now();
+    // repeated filler has no reordering delay, the frames after it may start with a lower DTS
+    if(lastVideoDts_ != AV_NOPTS_VALUE && pPacket->dts <= lastVideoDts_ && lastVideoDts_ + 1 <= pPacket->pts)
+        pPacket->dts = lastVideoDts_ + 1;
+
+    lastVideoDts_ = pPacket->dts;
 
-    int bufferedSamples = 0;
-    for(auto buf : bufferedAudio_)
+    result = av_interleaved_write_frame(pFormatContext_, pPacket);
+    if(result < 0)
     {
-        bufferedSamples += (*buf.pSamples)->nb_samples - buf.firstSample;
+        LOG(ERROR) << "Error while writing frame data: " << err2str(result);
+        return -1;
     }
 
-    if(bufferedSamples < pAudioCodecContext_->frame_size && !flush)
+    return 0;
+}
+
+bool MediaEncoder::createFiller(const AVFrame* pVideo)
+{
+    int result;
+    int64_t videoPtsInc = pVideoStream_->time_base.den * pVideoStream_->r_frame_rate.den / (pVideoStream_->time_base.num * pVideoStream_->r_frame_rate.num);
+
+    // same settings as the main encoder, but without frame reordering
+    AVCodecContext* pContext = avcodec_alloc_context3(pVideoCodec_);
+    if(!pContext)
     {
-        // not enough audio samples for a full frame
-        return 0;
+        LOG(ERROR) << "No memory for filler codec context";
+        return false;
     }
 
-    int encSamples = bufferedSamples;
-    if(encSamples > pAudioCodecContext_->frame_size)
-        encSamples = pAudioCodecContext_->frame_size;
+    av_opt_copy(pContext->priv_data, pVideoCodecContext_->priv_data);
 
-    // we have enough samples to fill an audio frame for encoding
-    const AVFrame* pAudio = *(bufferedAudio_.front().pSamples);
+    fillerFrames_ = std::max(1, (int)(FILLER_DURATION_S * av_q2d(pVideoCodecContext_->framerate) + 0.5));
 
-    AVFrame* pAudioBuf = av_frame_alloc();
-    pAudioBuf->nb_samples = encSamples;
-    pAudioBuf->format = pAudio->format;
-    pAudioBuf->sample_rate = pAudio->sample_rate;
-    pAudioBuf->channel_layout = pAudio->channel_layout;
-    pAudioBuf->channels = pAudio->channels;
-    pAudioBuf->pts = curAudioPts_;
-    curAudioPts_ += audioPtsInc * encSamples;
+    pContext->width = pVideoCodecContext_->width;
+    pContext->height = pVideoCodecContext_->height;
+    pContext->sample_aspect_ratio = pVideoCodecContext_->sample_aspect_ratio;
+    pContext->pix_fmt = pVideoCodecContext_->pix_fmt;
+    pContext->bit_rate = pVideoCodecContext_->bit_rate;
+    pContext->time_base = pVideoCodecContext_->time_base;
+    pContext->framerate = pVideoCodecContext_->framerate;
+    pContext->flags = pVideoCodecContext_->flags;
+    pContext->gop_size = fillerFrames_;
+    pContext->max_b_frames = 0;
 
-    LOG_IF(debug_, INFO) << "Filling audio frame. PTS: " << pAudioBuf->pts << ", buffered: " << bufferedSamples << ", enc: " << encSamples;
+    result = avcodec_open2(pContext, pVideoCodec_, NULL);
+    if(result < 0)
+    {
+        LOG(ERROR) << "avcodec_open2 (filler) failed: " << err2str(result);
+        avcodec_free_context(&pContext);
+        return false;
+    }
 
-    av_frame_get_buffer(pAudioBuf, 0);
+    bool success = true;
 
-    int samplesLeft = encSamples;
-    int dstOffset = 0;
-    for(auto iter = bufferedAudio_.begin(); iter != bufferedAudio_.end(); )
+    for(int i = 0; i <= fillerFrames_ && success; i++)
     {
-        int copySize = (*iter->pSamples)->nb_samples - iter->firstSample;
-        if(copySize > samplesLeft)
-            copySize = samplesLeft;
+        AVFrame* pEnc = nullptr;
 
-        av_samples_copy(pAudioBuf->data, (*iter->pSamples)->data, dstOffset, iter->firstSample, copySize, pAudioBuf->channels, (enum AVSampleFormat)pAudioBuf->format);
+        if(i < fillerFrames_)
+        {
+            pEnc = av_frame_clone(pVideo);
+            pEnc->pts = i * videoPtsInc;
+            pEnc->pict_type = AV_PICTURE_TYPE_NONE;
+        }
 
-        samplesLeft -= copySize;
-        dstOffset += copySize;
-        iter->firstSample += copySize;
+        result = avcodec_send_frame(pContext, pEnc);
 
-        bool remove = iter->firstSample >= (*iter->pSamples)->nb_samples;
+        av_frame_free(&pEnc);
 
-        iter++;
+        if(result < 0)
+        {
+            LOG(ERROR) << "avcodec_send_frame (filler) error: " << err2str(result);
+            success = false;
+            break;
+        }
 
-        if(remove)
-            bufferedAudio_.pop_front();
+        while(1)
+        {
+            auto pPacket = std::make_shared<AVPacketWrapper>();
 
-        if(samplesLeft <= 0)
-            break;
+            result = avcodec_receive_packet(pContext, *pPacket);
+            if(result == AVERROR(EAGAIN) || result == AVERROR_EOF)
+                break;
+
+            if(result < 0)
+            {
+                LOG(ERROR) << "Error while receiving packet from encoder (filler): " << err2str(result);
+                success = false;
+                break;
+            }
+
+            if(fillerPackets_.empty())
+                prependHeaders(*pPacket, pContext);
+
+            (*pPacket)->stream_index = pVideoStream_->index;
+            (*pPacket)->duration = videoPtsInc;
+
+            fillerPackets_.push_back(pPacket);
+        }
     }
 
-    AVFrame* pAudioEnc = av_frame_alloc();
-    pAudioEnc->nb_samples = pAudioBuf->nb_samples;
-    pAudioEnc->format = AV_SAMPLE_FMT_FLTP;
-    pAudioEnc->sample_rate = pAudioBuf->sample_rate;
-    pAudioEnc->channel_layout = pAudioBuf->channel_layout;
-    pAudioEnc->channels = pAudioBuf->channels;
-    pAudioEnc->pts = pAudioBuf->pts;
+    avcodec_free_context(&pContext);
 
-    LOG_IF(debug_, INFO) << "Encoding audio frame. PTS: " << pAudioEnc->pts << ", channel_layout: " << pAudioEnc->channel_layout;
+    if(!success || fillerPackets_.empty())
+    {
+        fillerPackets_.clear();
+        return false;
+    }
 
-    av_frame_get_buffer(pAudioEnc, 0);
+    LOG(INFO) << "Filler encoded: " << fillerFrames_ << " frames, " << fillerPackets_.size() << " packets";
+
+    return true;
+}
+
+int MediaEncoder::writePendingFiller()
+{
+    while(!pendingFiller_.empty())
+    {
+        if(writeVideoPacket(*pendingFiller_.front()) < 0)
+            return -1;
+
+        pendingFiller_.pop_front();
+    }
+
+    return 0;
+}
+
+void MediaEncoder::prependHeaders(AVPacket* pPacket, const AVCodecContext* pContext)
+{
+    // without global header the encoder already repeats them in-band
+    if(pContext->extradata_size <= 0)
+        return;
+
+    AVPacketWrapper pOut;
+    av_new_packet(pOut, pContext->extradata_size + pPacket->size);
+    memcpy(pOut->data, pContext->extradata, pContext->extradata_size);
+    memcpy(pOut->data + pContext->extradata_size, pPacket->data, pPacket->size);
+    av_packet_copy_props(pOut, pPacket);
+
+    av_packet_unref(pPacket);
+    av_packet_move_ref(pPacket, pOut);
+}
+
+int MediaEncoder::putFiller(std::shared_ptr<const MediaFrame> pFrame, int numFrames)
+{
+    int result;
+
+    if(!initialized_)
+    {
+        if(!initialize(pFrame))
+        {
+            return -1;
+        }
+    }
+
+    if(pVideoCodecContext_ && pFrame->pImage)
+    {
+        int64_t videoPtsInc = pVideoStream_->time_base.den * pVideoStream_->r_frame_rate.den / (pVideoStream_->time_base.num * pVideoStream_->r_frame_rate.num);
+
+        if(fillerPackets_.empty() && !createFiller(*(pFrame->pImage)))
+            return -1;
+
+        // the encoder may still hold frames before the filler, so the packets are queued until it returned them
+        for(int frame = 0; frame < numFrames; frame += fillerFrames_)
+        {
+            const int64_t limit = (numFrames - frame) * videoPtsInc;
+
+            for(const auto& pFiller : fillerPackets_)
+            {
+                if((*pFiller)->pts >= limit)
+                    continue;
+
+                auto pPacket = std::make_shared<AVPacketWrapper>();
+                av_packet_ref(*pPacket, *pFiller);
+
+                (*pPacket)->pts += curVideoPts_;
+                (*pPacket)->dts += curVideoPts_;
+
+                pendingFiller_.push_back(pPacket);
+            }
+
+            curVideoPts_ += std::min(fillerFrames_, numFrames - frame) * videoPtsInc;
+        }
+
+        pendingFillerEndPts_ = curVideoPts_;
+        forceKeyframe_ = true;
+    }
+
+    if(pAudioCodecContext_ && pFrame->pSamples)
+    {
+        // audio encoding is cheap, silence just runs through the encoder
+        for(int frame = 0; frame < numFrames; frame++)
+        {
+            result = putAudio(*pFrame->pSamples);
+            if(result < 0)
+                return result;
+        }
+    }
+
+    return 0;
+}
+
+int MediaEncoder::putAudio(const AVFrame* pAudio)
+{
+    int result;
+
+    if(pAudio)
+    {
+        result = bufferAudioFrame(pAudio);
+        if(result < 0)
+            return result;
+    }
+
+    int sendFrameResult = 0;
+
+    do
+    {
+        sendFrameResult = sendAudioFrameFromBuffer(false);
+        if(sendFrameResult < 0)
+        {
+            return sendFrameResult;
+        }
+        else
+        {
+            result = receiveAudioPackets();
+            if(result < 0)
+                return result;
+        }
+    }
+    while(sendFrameResult > 0);
+
+    return 0;
+}
+
+int MediaEncoder::bufferAudioFrame(const AVFrame* pAudio)
+{
+    int result;
+
+    auto tStart = std::chrono::high_resolution_clock::now();
 
     if(pResampler_)
     {
-        result = swr_convert_frame(pResampler_, pAudioEnc, pAudioBuf);
+        AVFrame* pConverted = av_frame_alloc();
+        pConverted->nb_samples = pAudio->nb_samples;
+        pConverted->format = AV_SAMPLE_FMT_FLTP;
+        pConverted->sample_rate = pAudio->sample_rate;
+        pConverted->channel_layout = pAudio->channel_layout;
+        pConverted->channels = pAudio->channels;
+
+        result = av_frame_get_buffer(pConverted, 0);
+        if(result < 0)
+        {
+            LOG(ERROR) << "Could not allocate converted audio frame: " << err2str(result);
+            av_frame_free(&pConverted);
+            return -1;
+        }
+
+        result = swr_convert_frame(pResampler_, pConverted, pAudio);
         if(result < 0)
         {
             LOG(ERROR) << "Audio conversion failed: " << err2str(result);
+            av_frame_free(&pConverted);
             return -1;
         }
+
+        result = av_audio_fifo_write(pAudioFifo_, (void**)pConverted->extended_data, pConverted->nb_samples);
+
+        av_frame_free(&pConverted);
     }
     else
     {
-        av_frame_copy(pAudioEnc, pAudioBuf);
+        result = av_audio_fifo_write(pAudioFifo_, (void**)pAudio->extended_data, pAudio->nb_samples);
+    }
+
+    if(result < 0)
+    {
+        LOG(ERROR) << "Writing to audio FIFO failed: " << err2str(result);
+        return -1;
     }
 
     auto tCopy = std::chrono::high_resolution_clock::now();
     audioTiming_.copy = std::chrono::duration_cast<std::chrono::microseconds>(tCopy - tStart).count() * 1e-6f;
 
+    return 0;
+}
+
+int MediaEncoder::sendAudioFrameFromBuffer(bool flush)
+{
+    int result;
+    int audioPtsInc = pAudioStream_->time_base.den / (pAudioStream_->time_base.num * pAudioCodecContext_->sample_rate);
+
+    const int bufferedSamples = av_audio_fifo_size(pAudioFifo_);
+
+    if(bufferedSamples < pAudioCodecContext_->frame_size && !flush)
+    {
+        // not enough audio samples for a full frame
+        return 0;
+    }
+
+    const int encSamples = std::min(bufferedSamples, pAudioCodecContext_->frame_size);
+    if(encSamples <= 0)
+        return 0;
+
+    AVFrame* pAudioEnc = av_frame_alloc();
+    pAudioEnc->nb_samples = encSamples;
+    pAudioEnc->format = AV_SAMPLE_FMT_FLTP;
+    pAudioEnc->sample_rate = pAudioCodecContext_->sample_rate;
+    pAudioEnc->channel_layout = pAudioCodecContext_->channel_layout;
+    pAudioEnc->channels = pAudioCodecContext_->channels;
+    pAudioEnc->pts = curAudioPts_;
+    curAudioPts_ += audioPtsInc * encSamples;
+
+    LOG_IF(debug_, INFO) << "Encoding audio frame. PTS: " << pAudioEnc->pts << ", buffered: " << bufferedSamples << ", enc: " << encSamples;
+
+    av_frame_get_buffer(pAudioEnc, 0);
+
+    av_audio_fifo_read(pAudioFifo_, (void**)pAudioEnc->extended_data, encSamples);
+
+    auto tRead = std::chrono::high_resolution_clock::now();
+
     result = avcodec_send_frame(pAudioCodecContext_, pAudioEnc);
+
+    av_frame_free(&pAudioEnc);
+
     if(result < 0)
     {
         LOG(ERROR) << "avcodec_send_frame (audio) error: " << err2str(result);
         return -1;
     }
 
-    av_frame_free(&pAudioBuf);
-    av_frame_free(&pAudioEnc);
-
     auto tSend = std::chrono::high_resolution_clock::now();
-    audioTiming_.send = std::chrono::duration_cast<std::chrono::microseconds>(tSend - tCopy).count() * 1e-6f;
+    audioTiming_.send = std::chrono::duration_cast<std::chrono::microseconds>(tSend - tRead).count() * 1e-6f;
 
     return 1;
 }
@@ -541,34 +883,23 @@ int MediaEncoder::put(std::shared_ptr<const MediaFrame> pFrame)
         result = receiveVideoPackets();
         if(result < 0)
             return result;
+
+        // filler at the very end of the video
+        if(!pFrame)
+        {
+            result = writePendingFiller();
+            if(result < 0)
+                return result;
+        }
     }
 
     if(pAudioCodecContext_)
     {
         int audioPtsInc = pAudioStream_->time_base.den / (pAudioStream_->time_base.num * pAudioCodecContext_->sample_rate);
 
-        if(pFrame && pFrame->pSamples)
-        {
-            bufferedAudio_.push_back((BufferedAudioFrame){pFrame->pSamples, 0});
-        }
-
-        int sendFrameResult = 0;
-
-        do
-        {
-            sendFrameResult = sendAudioFrameFromBuffer(false);
-            if(sendFrameResult < 0)
-            {
-                return sendFrameResult;
-            }
-            else
-            {
-                result = receiveAudioPackets();
-                if(result < 0)
-                    return result;
-            }
-        }
-        while(sendFrameResult > 0);
+        result = putAudio(pFrame && pFrame->pSamples ? (const AVFrame*)*pFrame->pSamples : nullptr);
+        if(result < 0)
+            return result;
 
         if(!pFrame)
         {
@@ -2,12 +2,15 @@
 
 extern "C" {
 #include "libswresample/swresample.h"
+#include "libavutil/audio_fifo.h"
 }
 
 #include "MediaFrame.hpp"
+#include "FileWriter.hpp"
 
-#include <string>
 #include <deque>
+#include <string>
+#include <vector>
 
 class MediaEncoder
 {
@@ -23,25 +26,43 @@ public:
     MediaEncoder(std::string filename, bool useHwEncoder = false);
     ~MediaEncoder();
 
+    void setGopSize(int gopSize) { gopSize_ = gopSize; }
+    void useFastDecode(bool enable) { fastDecode_ = enable; }
+    void setExpectedDuration(double duration_s) { expectedDuration_s_ = duration_s; }
+
+    // write fragmented MP4, the file is playable up to the last keyframe while encoding continues
+    void useFragments(bool enable) { fragmented_ = enable; }
+
+    // frames at these output times start a closed GOP, so the output can be cut there without re-encoding
+    void setKeyframeTimes(std::vector<double> times_s);
+
     int put(std::shared_ptr<const MediaFrame> pFrame);
+
+    // same as putting the frame numFrames times, but the image is only encoded for one short GOP
+    // whose packets are repeated, the next regular frame starts with a keyframe
+    int putFiller(std::shared_ptr<const MediaFrame> pFrame, int numFrames);
     void close();
 
     Timing getVideoTiming() const { return videoTiming_; }
     Timing getAudioTiming() const { return audioTiming_; }
 
-private:
-    struct BufferedAudioFrame
-    {
-        std::shared_ptr<AVFrameWrapper> pSamples;
-        int firstSample;
-    };
+    // MP4 muxer flags for files which can be played while they are written
+    static constexpr const char* FRAGMENTED_MOVFLAGS = "frag_keyframe+empty_moov+default_base_moof";
 
+private:
     bool initialize(std::shared_ptr<const MediaFrame> pFrame);
     std::string err2str(int errnum);
 
     int sendVideoFrame(const AVFrame* pVideo);
     int receiveVideoPackets();
+    int writeVideoPacket(AVPacket* pPacket);
+
+    bool createFiller(const AVFrame* pVideo);
+    int writePendingFiller();
+    static void prependHeaders(AVPacket* pPacket, const AVCodecContext* pContext);
 
+    int putAudio(const AVFrame* pAudio);
+    int bufferAudioFrame(const AVFrame* pAudio);
     int sendAudioFrameFromBuffer(bool flush);
     int receiveAudioPackets();
 
@@ -51,8 +72,10 @@ private:
 
     int64_t curVideoPts_;
     int64_t curAudioPts_;
+    int64_t lastVideoDts_;
 
     AVFormatContext* pFormatContext_;
+    std::unique_ptr<FileWriter> pFileWriter_;
 
     AVStream* pVideoStream_;
     const AVCodec* pVideoCodec_;
@@ -63,10 +86,28 @@ private:
     AVCodecContext* pAudioCodecContext_;
 
     SwrContext* pResampler_;
-    std::deque<BufferedAudioFrame> bufferedAudio_;
+    AVAudioFifo* pAudioFifo_;
 
     bool useHwEncoder_;
+    int gopSize_;
+    bool fastDecode_;
+    double expectedDuration_s_;
+    bool fragmented_;
+
+    // filler GOP with timestamps starting at zero, and repetitions waiting until the encoder
+    // has returned all frames before them
+    std::vector<std::shared_ptr<AVPacketWrapper>> fillerPackets_;
+    int fillerFrames_;
+    std::deque<std::shared_ptr<AVPacketWrapper>> pendingFiller_;
+    int64_t pendingFillerEndPts_;
+    bool forceKeyframe_;
+    bool prependHeaders_;
+
+    std::vector<double> keyframeTimes_s_;
+    size_t nextKeyframe_;
 
     Timing videoTiming_;
     Timing audioTiming_;
+
+    static constexpr double FILLER_DURATION_S = 1.0;
 };
@@ -0,0 +1,361 @@
+#include "MediaRemuxer.hpp"
+#include "MediaEncoder.hpp"
+#include "util/easylogging++.h"
+#include <algorithm>
+#include <cstring>
+
+MediaRemuxer::MediaRemuxer(std::string filename)
+:debug_(false),
+ filename_(filename),
+ initialized_(false),
+ fragmented_(false),
+ pFormatContext_(0),
+ offset_us_(0)
+{
+}
+
+MediaRemuxer::~MediaRemuxer()
+{
+    close();
+}
+
+bool MediaRemuxer::initialize(AVFormatContext* pInput)
+{
+    int result;
+
+    result = avformat_alloc_output_context2(&pFormatContext_, NULL, NULL, filename_.c_str());
+    if(result < 0)
+    {
+        LOG(ERROR) << "Could not create output context: " << err2str(result);
+        return false;
+    }
+
+    // audio and video streams are copied as they are
+    for(unsigned int i = 0; i < pInput->nb_streams; i++)
+    {
+        const AVStream* pInStream = pInput->streams[i];
+        const enum AVMediaType type = pInStream->codecpar->codec_type;
+
+        if(type != AVMEDIA_TYPE_VIDEO && type != AVMEDIA_TYPE_AUDIO)
+        {
+            streamMap_.push_back(-1);
+            continue;
+        }
+
+        AVStream* pOutStream = avformat_new_stream(pFormatContext_, NULL);
+        if(!pOutStream)
+        {
+            LOG(ERROR) << "Could not create output stream";
+            return false;
+        }
+
+        avcodec_parameters_copy(pOutStream->codecpar, pInStream->codecpar);
+        pOutStream->codecpar->codec_tag = 0;
+        pOutStream->time_base = pInStream->time_base;
+        pOutStream->r_frame_rate = pInStream->r_frame_rate;
+
+        streamMap_.push_back(pOutStream->index);
+        lastDts_.push_back(AV_NOPTS_VALUE);
+        audioTail_.emplace_back();
+    }
+
+    pFileWriter_ = std::make_unique<FileWriter>();
+    if(!pFileWriter_->open(filename_))
+    {
+        LOG(ERROR) << "Opening output file failed: " << filename_;
+        return false;
+    }
+
+    pFormatContext_->pb = pFileWriter_->getAVIOContext();
+
+    AVDictionary* pOptions = nullptr;
+    if(fragmented_)
+        av_dict_set(&pOptions, "movflags", MediaEncoder::FRAGMENTED_MOVFLAGS, 0);
+
+    result = avformat_write_header(pFormatContext_, &pOptions);
+    av_dict_free(&pOptions);
+    if(result < 0)
+    {
+        LOG(ERROR) << "Writing file header failed: " << err2str(result);
+        return false;
+    }
+
+    initialized_ = true;
+
+    return true;
+}
+
+bool MediaRemuxer::append(const std::string& inputFile)
+{
+    int result;
+
+    AVFormatContext* pInput = nullptr;
+
+    result = avformat_open_input(&pInput, inputFile.c_str(), NULL, NULL);
+    if(result < 0)
+    {
+        LOG(ERROR) << "Could not open " << inputFile << ": " << err2str(result);
+        return false;
+    }
+
+    result = avformat_find_stream_info(pInput, NULL);
+    if(result < 0)
+    {
+        LOG(ERROR) << "Could not find stream info of " << inputFile << ": " << err2str(result);
+        avformat_close_input(&pInput);
+        return false;
+    }
+
+    if(!initialized_ && !initialize(pInput))
+    {
+        avformat_close_input(&pInput);
+        return false;
+    }
+
+    if(!isCompatible(pInput))
+    {
+        LOG(ERROR) << "Streams of " << inputFile << " do not match " << filename_;
+        avformat_close_input(&pInput);
+        return false;
+    }
+
+    LOG(INFO) << "Appending " << inputFile << " at " << offset_us_ * 1e-6 << "s";
+
+    int64_t videoEnd_us = 0;
+    int64_t otherEnd_us = 0;
+
+    std::vector<bool> streamStarted(pFormatContext_->nb_streams, false);
+
+    AVPacketWrapper pPacket;
+
+    while(av_read_frame(pInput, pPacket) >= 0)
+    {
+        const int outIndex = streamMap_[pPacket->stream_index];
+        if(outIndex < 0)
+        {
+            av_packet_unref(pPacket);
+            continue;
+        }
+
+        const AVStream* pOutStream = pFormatContext_->streams[outIndex];
+        const int64_t offset = av_rescale_q(offset_us_, AV_TIME_BASE_Q, pOutStream->time_base);
+
+        av_packet_rescale_ts(pPacket, pInput->streams[pPacket->stream_index]->time_base, pOutStream->time_base);
+
+        if(pPacket->pts != AV_NOPTS_VALUE)
+            pPacket->pts += offset;
+
+        if(pPacket->dts != AV_NOPTS_VALUE)
+            pPacket->dts += offset;
+
+        pPacket->stream_index = outIndex;
+        pPacket->pos = -1;
+
+        if(pPacket->pts != AV_NOPTS_VALUE)
+        {
+            const int64_t end_us = av_rescale_q(pPacket->pts + pPacket->duration, pOutStream->time_base, AV_TIME_BASE_Q);
+
+            if(pOutStream->codecpar->codec_type == AVMEDIA_TYPE_VIDEO)
+                videoEnd_us = std::max(videoEnd_us, end_us);
+            else
+                otherEnd_us = std::max(otherEnd_us, end_us);
+        }
+
+        if(pOutStream->codecpar->codec_type != AVMEDIA_TYPE_AUDIO)
+        {
+            if(!writePacket(pPacket))
+            {
+                avformat_close_input(&pInput);
+                return false;
+            }
+
+            continue;
+        }
+
+        // the first packet primes the decoder, it is kept and the end of the previous file is trimmed instead
+        auto& tail = audioTail_[outIndex];
+
+        if(!streamStarted[outIndex] && pPacket->pts != AV_NOPTS_VALUE)
+        {
+            while(!tail.empty() && (*tail.back())->pts + (*tail.back())->duration > pPacket->pts)
+            {
+                LOG_IF(debug_, INFO) << "Trimming overlapping audio packet, stream: " << outIndex << ", PTS: " << (*tail.back())->pts;
+                tail.pop_back();
+            }
+
+            streamStarted[outIndex] = true;
+        }
+
+        auto pHeld = std::make_shared<AVPacketWrapper>();
+        av_packet_move_ref(*pHeld, pPacket);
+        tail.push_back(pHeld);
+
+        if(tail.size() > AUDIO_TAIL_PACKETS)
+        {
+            const bool success = writePacket(*tail.front());
+            tail.pop_front();
+
+            if(!success)
+            {
+                avformat_close_input(&pInput);
+                return false;
+            }
+        }
+    }
+
+    avformat_close_input(&pInput);
+
+    // next file starts where the video of this one ended, audio follows video to stay in sync
+    offset_us_ = videoEnd_us > 0 ? videoEnd_us : otherEnd_us;
+
+    return true;
+}
+
+bool MediaRemuxer::close()
+{
+    int result;
+    bool success = true;
+
+    if(initialized_)
+    {
+        for(size_t i = 0; i < audioTail_.size(); i++)
+        {
+            if(!flushTail(i))
+                success = false;
+        }
+
+        result = av_write_trailer(pFormatContext_);
+        if(result < 0)
+        {
+            LOG(ERROR) << "Writing trailer failed: " << err2str(result);
+            success = false;
+        }
+
+        if(pFileWriter_ && pFileWriter_->close() < 0)
+            success = false;
+
+        LOG(INFO) << "Remuxed " << filename_ << ", duration: " << offset_us_ * 1e-6 << "s";
+    }
+
+    if(pFormatContext_)
+        avformat_free_context(pFormatContext_);
+
+    pFileWriter_.reset();
+
+    initialized_ = false;
+    pFormatContext_ = 0;
+
+    return success;
+}
+
+double MediaRemuxer::probeDuration_s(const std::string& inputFile)
+{
+    AVFormatContext* pInput = nullptr;
+
+    if(avformat_open_input(&pInput, inputFile.c_str(), NULL, NULL) < 0)
+        return -1.0;
+
+    if(avformat_find_stream_info(pInput, NULL) < 0)
+    {
+        avformat_close_input(&pInput);
+        return -1.0;
+    }
+
+    double duration_s = pInput->duration != AV_NOPTS_VALUE ? pInput->duration * 1e-6 : -1.0;
+
+    for(unsigned int i = 0; i < pInput->nb_streams; i++)
+    {
+        const AVStream* pStream = pInput->streams[i];
+        if(pStream->duration != AV_NOPTS_VALUE)
+            duration_s = std::max(duration_s, pStream->duration * av_q2d(pStream->time_base));
+    }
+
+    avformat_close_input(&pInput);
+
+    return duration_s;
+}
+
+bool MediaRemuxer::isCompatible(AVFormatContext* pInput) const
+{
+    if(pInput->nb_streams != streamMap_.size())
+        return false;
+
+    // packets are only valid with the parameters of the first file
+    for(unsigned int i = 0; i < pInput->nb_streams; i++)
+    {
+        if(streamMap_[i] < 0)
+            continue;
+
+        const AVCodecParameters* pIn = pInput->streams[i]->codecpar;
+        const AVCodecParameters* pOut = pFormatContext_->streams[streamMap_[i]]->codecpar;
+
+        if(pIn->codec_type != pOut->codec_type || pIn->codec_id != pOut->codec_id ||
+           pIn->width != pOut->width || pIn->height != pOut->height ||
+           pIn->sample_rate != pOut->sample_rate || pIn->channels != pOut->channels ||
+           pIn->extradata_size != pOut->extradata_size ||
+           (pIn->extradata_size > 0 && memcmp(pIn->extradata, pOut->extradata, pIn->extradata_size) != 0))
+        {
+            LOG(ERROR) << "Codec parameters of stream " << i << " differ";
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool MediaRemuxer::writePacket(AVPacket* pPacket)
+{
+    const int outIndex = pPacket->stream_index;
+
+    // reordering delay of the next file may overlap the previous one
+    if(pPacket->dts != AV_NOPTS_VALUE && lastDts_[outIndex] != AV_NOPTS_VALUE && pPacket->dts <= lastDts_[outIndex])
+    {
+        if(pPacket->pts != AV_NOPTS_VALUE && lastDts_[outIndex] + 1 <= pPacket->pts)
+        {
+            pPacket->dts = lastDts_[outIndex] + 1;
+        }
+        else
+        {
+            LOG_IF(debug_, INFO) << "Dropping overlapping packet, stream: " << outIndex << ", DTS: " << pPacket->dts;
+            av_packet_unref(pPacket);
+            return true;
+        }
+    }
+
+    if(pPacket->dts != AV_NOPTS_VALUE)
+        lastDts_[outIndex] = pPacket->dts;
+
+    const int result = av_interleaved_write_frame(pFormatContext_, pPacket);
+    if(result < 0)
+    {
+        LOG(ERROR) << "Error while writing packet: " << err2str(result);
+        return false;
+    }
+
+    return true;
+}
+
+bool MediaRemuxer::flushTail(int outIndex)
+{
+    auto& tail = audioTail_[outIndex];
+
+    while(!tail.empty())
+    {
+        const bool success = writePacket(*tail.front());
+        tail.pop_front();
+
+        if(!success)
+            return false;
+    }
+
+    return true;
+}
+
+std::string MediaRemuxer::err2str(int errnum)
+{
+    std::string msg(AV_ERROR_MAX_STRING_SIZE, 0);
+
+    av_strerror(errnum, msg.data(), msg.size());
+
+    return msg;
+}
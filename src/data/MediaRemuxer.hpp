@@ -0,0 +1,53 @@
+#pragma once
+
+#include "AVWrapper.hpp"
+#include "FileWriter.hpp"
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Copies encoded streams of one or more files into a new file without
+// re-encoding. Appended files continue the timestamps of the previous ones.
+class MediaRemuxer
+{
+public:
+    MediaRemuxer(std::string filename);
+    ~MediaRemuxer();
+
+    void useFragments(bool enable) { fragmented_ = enable; }
+
+    bool append(const std::string& inputFile);
+    bool close();
+
+    double getDuration_s() const { return offset_us_ * 1e-6; }
+
+    // duration of the longest stream in a complete file, -1 if it cannot be read
+    static double probeDuration_s(const std::string& inputFile);
+
+private:
+    bool initialize(AVFormatContext* pInput);
+    bool isCompatible(AVFormatContext* pInput) const;
+    bool writePacket(AVPacket* pPacket);
+    bool flushTail(int outIndex);
+    std::string err2str(int errnum);
+
+    bool debug_;
+    std::string filename_;
+    bool initialized_;
+    bool fragmented_;
+
+    AVFormatContext* pFormatContext_;
+    std::unique_ptr<FileWriter> pFileWriter_;
+
+    // output stream index for each input stream, -1 if not copied
+    std::vector<int> streamMap_;
+    std::vector<int64_t> lastDts_;
+    int64_t offset_us_;
+
+    // last audio packets per output stream, those overlapping the priming of the next file are dropped
+    std::vector<std::deque<std::shared_ptr<AVPacketWrapper>>> audioTail_;
+
+    static constexpr size_t AUDIO_TAIL_PACKETS = 8;
+};
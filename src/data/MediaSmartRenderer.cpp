@@ -0,0 +1,1075 @@
+#include "MediaSmartRenderer.hpp"
+#include "MediaEncoder.hpp"
+#include "util/easylogging++.h"
+#include <algorithm>
+#include <cstring>
+
+extern "C" {
+#include <libavutil/opt.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/samplefmt.h>
+}
+
+MediaSmartRenderer::MediaSmartRenderer(std::string filename, const std::atomic<bool>& shouldAbort)
+:debug_(false),
+ filename_(filename),
+ shouldAbort_(shouldAbort),
+ initialized_(false),
+ fragmented_(false),
+ pFormatContext_(0),
+ pVideoStream_(0),
+ pAudioStream_(0),
+ pEncoder_(0),
+ lastVideoDts_(AV_NOPTS_VALUE),
+ lastAudioDts_(AV_NOPTS_VALUE),
+ pieceStart_us_(0),
+ outStart_us_(0),
+ fillerDuration_us_(0),
+ copied_s_(0.0),
+ encoded_s_(0.0),
+ filler_s_(0.0)
+{
+}
+
+MediaSmartRenderer::~MediaSmartRenderer()
+{
+    close();
+}
+
+bool MediaSmartRenderer::isCompatible(const std::vector<std::string>& sourceFiles)
+{
+    if(sourceFiles.empty())
+        return false;
+
+    if(!avcodec_find_encoder_by_name("libx264"))
+    {
+        LOG(INFO) << "Smart render not possible, libx264 is not available";
+        return false;
+    }
+
+    Input first;
+    if(!openInput(sourceFiles.front(), first))
+        return false;
+
+    const AVCodecParameters* pFirstVideo = first.pVideoStream->codecpar;
+    const AVCodecParameters* pFirstAudio = first.pAudioStream ? first.pAudioStream->codecpar : nullptr;
+
+    bool compatible = true;
+
+    // only MP4 style H.264 can be copied, the parameter sets must be available out of band
+    if(pFirstVideo->codec_id != AV_CODEC_ID_H264 || first.parameterSets.empty())
+    {
+        LOG(INFO) << "Smart render not possible, " << sourceFiles.front() << " is not H.264 with avcC extradata";
+        compatible = false;
+    }
+
+    // boundary frames are encoded in the profile and level of the sources, which must be one x264 produces
+    const int profile = pFirstVideo->profile & ~FF_PROFILE_H264_CONSTRAINED;
+    if(compatible && profile != FF_PROFILE_H264_BASELINE && profile != FF_PROFILE_H264_MAIN && profile != FF_PROFILE_H264_HIGH)
+    {
+        LOG(INFO) << "Smart render not possible, H.264 profile " << pFirstVideo->profile << " of " << sourceFiles.front() << " cannot be encoded";
+        compatible = false;
+    }
+
+    for(size_t i = 1; i < sourceFiles.size() && compatible; i++)
+    {
+        Input other;
+        if(!openInput(sourceFiles[i], other))
+        {
+            compatible = false;
+            break;
+        }
+
+        const AVCodecParameters* pVideo = other.pVideoStream->codecpar;
+        const AVCodecParameters* pAudio = other.pAudioStream ? other.pAudioStream->codecpar : nullptr;
+
+        if(pVideo->codec_id != pFirstVideo->codec_id || other.parameterSets.empty() ||
+           pVideo->width != pFirstVideo->width || pVideo->height != pFirstVideo->height || pVideo->format != pFirstVideo->format ||
+           pVideo->profile != pFirstVideo->profile || pVideo->level != pFirstVideo->level)
+        {
+            LOG(INFO) << "Smart render not possible, video of " << sourceFiles[i] << " does not match " << sourceFiles.front();
+            compatible = false;
+        }
+        else if((pAudio == nullptr) != (pFirstAudio == nullptr) || (pAudio && (pAudio->codec_id != pFirstAudio->codec_id ||
+                 pAudio->sample_rate != pFirstAudio->sample_rate || pAudio->channels != pFirstAudio->channels)))
+        {
+            LOG(INFO) << "Smart render not possible, audio of " << sourceFiles[i] << " does not match " << sourceFiles.front();
+            compatible = false;
+        }
+
+        closeInput(other);
+    }
+
+    closeInput(first);
+
+    return compatible;
+}
+
+double MediaSmartRenderer::findKeyframe_s(const std::string& sourceFile, double t_s)
+{
+    Input input;
+    if(!openInput(sourceFile, input))
+        return -1.0;
+
+    AVStream* pInVideo = input.pVideoStream;
+    const int64_t t = av_rescale_q((int64_t)(t_s * 1e6), AV_TIME_BASE_Q, pInVideo->time_base);
+
+    // walk back through the index until a keyframe is presented in time
+    int64_t keyPts = AV_NOPTS_VALUE;
+
+    for(int i = avformat_index_get_entries_count(pInVideo) - 1; i >= 0 && keyPts == AV_NOPTS_VALUE; i--)
+    {
+        const AVIndexEntry* pEntry = avformat_index_get_entry(pInVideo, i);
+
+        if(!(pEntry->flags & AVINDEX_KEYFRAME) || pEntry->timestamp > t)
+            continue;
+
+        const int64_t pts = getKeyframePts(input, pEntry->timestamp);
+        if(pts != AV_NOPTS_VALUE && pts <= t)
+            keyPts = pts;
+    }
+
+    const double key_s = keyPts != AV_NOPTS_VALUE ? keyPts * av_q2d(pInVideo->time_base) : -1.0;
+
+    closeInput(input);
+
+    return key_s;
+}
+
+bool MediaSmartRenderer::openInput(const std::string& filename, Input& input)
+{
+    int result;
+
+    result = avformat_open_input(&input.pFormatContext, filename.c_str(), NULL, NULL);
+    if(result < 0)
+    {
+        LOG(ERROR) << "Could not open " << filename << ": " << err2str(result);
+        return false;
+    }
+
+    result = avformat_find_stream_info(input.pFormatContext, NULL);
+    if(result < 0)
+    {
+        LOG(ERROR) << "Could not find stream info of " << filename << ": " << err2str(result);
+        closeInput(input);
+        return false;
+    }
+
+    int videoIndex = av_find_best_stream(input.pFormatContext, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+    if(videoIndex < 0)
+    {
+        LOG(ERROR) << "No video stream in " << filename;
+        closeInput(input);
+        return false;
+    }
+
+    input.pVideoStream = input.pFormatContext->streams[videoIndex];
+
+    int audioIndex = av_find_best_stream(input.pFormatContext, AVMEDIA_TYPE_AUDIO, -1, videoIndex, NULL, 0);
+    if(audioIndex >= 0)
+        input.pAudioStream = input.pFormatContext->streams[audioIndex];
+
+    const AVCodecParameters* pParams = input.pVideoStream->codecpar;
+
+    const AVCodec* pDecoder = avcodec_find_decoder(pParams->codec_id);
+    if(!pDecoder)
+    {
+        LOG(ERROR) << "No decoder for video of " << filename;
+        closeInput(input);
+        return false;
+    }
+
+    input.pDecoder = avcodec_alloc_context3(pDecoder);
+    avcodec_parameters_to_context(input.pDecoder, pParams);
+    input.pDecoder->thread_count = 0;
+
+    result = avcodec_open2(input.pDecoder, pDecoder, NULL);
+    if(result < 0)
+    {
+        LOG(ERROR) << "Could not open video decoder of " << filename << ": " << err2str(result);
+        closeInput(input);
+        return false;
+    }
+
+    // avcC: version, profile, compatibility, level, NAL length size, SPS count, SPSs, PPS count, PPSs
+    const uint8_t* pData = pParams->extradata;
+    const int size = pParams->extradata_size;
+
+    if(pParams->codec_id != AV_CODEC_ID_H264 || size < 7 || pData[0] != 1 || (pData[4] & 0x03) != 3)
+        return true;
+
+    std::vector<uint8_t> parameterSets;
+    int pos = 5;
+
+    for(int type = 0; type < 2; type++)
+    {
+        if(pos >= size)
+            return true;
+
+        const int count = type == 0 ? (pData[pos] & 0x1F) : pData[pos];
+        pos++;
+
+        for(int i = 0; i < count; i++)
+        {
+            if(pos + 2 > size)
+                return true;
+
+            const int length = (pData[pos] << 8) | pData[pos+1];
+            pos += 2;
+
+            if(pos + length > size)
+                return true;
+
+            parameterSets.push_back((length >> 24) & 0xFF);
+            parameterSets.push_back((length >> 16) & 0xFF);
+            parameterSets.push_back((length >> 8) & 0xFF);
+            parameterSets.push_back(length & 0xFF);
+            parameterSets.insert(parameterSets.end(), pData + pos, pData + pos + length);
+
+            pos += length;
+        }
+    }
+
+    input.parameterSets = parameterSets;
+
+    return true;
+}
+
+void MediaSmartRenderer::closeInput(Input& input)
+{
+    if(input.pDecoder)
+        avcodec_free_context(&input.pDecoder);
+
+    if(input.pFormatContext)
+        avformat_close_input(&input.pFormatContext);
+
+    input.pVideoStream = nullptr;
+    input.pAudioStream = nullptr;
+}
+
+int64_t MediaSmartRenderer::getKeyframePts(Input& input, int64_t dts)
+{
+    // index timestamps are decode timestamps for most containers, the presentation time is in the packet
+    if(av_seek_frame(input.pFormatContext, input.pVideoStream->index, dts, AVSEEK_FLAG_BACKWARD) < 0)
+        return AV_NOPTS_VALUE;
+
+    AVPacketWrapper pPacket;
+
+    while(av_read_frame(input.pFormatContext, pPacket) >= 0)
+    {
+        if(pPacket->stream_index == input.pVideoStream->index)
+        {
+            const int64_t pts = pPacket->pts != AV_NOPTS_VALUE ? pPacket->pts : pPacket->dts;
+            const bool isKey = pPacket->flags & AV_PKT_FLAG_KEY;
+
+            av_packet_unref(pPacket);
+
+            return isKey ? pts : AV_NOPTS_VALUE;
+        }
+
+        av_packet_unref(pPacket);
+    }
+
+    return AV_NOPTS_VALUE;
+}
+
+bool MediaSmartRenderer::initialize(const Input& input)
+{
+    int result;
+
+    result = avformat_alloc_output_context2(&pFormatContext_, NULL, NULL, filename_.c_str());
+    if(result < 0)
+    {
+        LOG(ERROR) << "Could not create output context: " << err2str(result);
+        return false;
+    }
+
+    pVideoStream_ = avformat_new_stream(pFormatContext_, NULL);
+    if(!pVideoStream_)
+    {
+        LOG(ERROR) << "Could not create video stream";
+        return false;
+    }
+
+    avcodec_parameters_copy(pVideoStream_->codecpar, input.pVideoStream->codecpar);
+
+    // avcC only describes the copied GOPs, avc3 makes decoders use the parameter sets in-band at every IDR frame
+    pVideoStream_->codecpar->codec_tag = MKTAG('a', 'v', 'c', '3');
+    pVideoStream_->time_base = input.pVideoStream->time_base;
+    pVideoStream_->r_frame_rate = input.pVideoStream->r_frame_rate;
+
+    if(input.pAudioStream)
+    {
+        pAudioStream_ = avformat_new_stream(pFormatContext_, NULL);
+        if(!pAudioStream_)
+        {
+            LOG(ERROR) << "Could not create audio stream";
+            return false;
+        }
+
+        avcodec_parameters_copy(pAudioStream_->codecpar, input.pAudioStream->codecpar);
+        pAudioStream_->codecpar->codec_tag = 0;
+        pAudioStream_->time_base = input.pAudioStream->time_base;
+    }
+
+    pFileWriter_ = std::make_unique<FileWriter>();
+    if(!pFileWriter_->open(filename_))
+    {
+        LOG(ERROR) << "Opening output file failed: " << filename_;
+        return false;
+    }
+
+    pFormatContext_->pb = pFileWriter_->getAVIOContext();
+
+    AVDictionary* pOptions = nullptr;
+    if(fragmented_)
+        av_dict_set(&pOptions, "movflags", MediaEncoder::FRAGMENTED_MOVFLAGS, 0);
+
+    result = avformat_write_header(pFormatContext_, &pOptions);
+    av_dict_free(&pOptions);
+    if(result < 0)
+    {
+        LOG(ERROR) << "Writing file header failed: " << err2str(result);
+        return false;
+    }
+
+    initialized_ = true;
+
+    return true;
+}
+
+bool MediaSmartRenderer::append(const std::string& sourceFile, double tStart_s, double duration_s)
+{
+    Input input;
+    if(!openInput(sourceFile, input))
+        return false;
+
+    if(!initialized_ && !initialize(input))
+    {
+        closeInput(input);
+        return false;
+    }
+
+    if((input.pAudioStream == nullptr) != (pAudioStream_ == nullptr))
+    {
+        LOG(ERROR) << "Stream layout of " << sourceFile << " does not match " << filename_;
+        closeInput(input);
+        return false;
+    }
+
+    AVStream* pInVideo = input.pVideoStream;
+    const AVRational timeBase = pInVideo->time_base;
+
+    pieceStart_us_ = (int64_t)(tStart_s * 1e6);
+
+    const int64_t start = av_rescale_q(pieceStart_us_, AV_TIME_BASE_Q, timeBase);
+    const int64_t end = av_rescale_q(pieceStart_us_ + (int64_t)(duration_s * 1e6), AV_TIME_BASE_Q, timeBase);
+
+    std::vector<int64_t> keyframes;
+
+    const int numEntries = avformat_index_get_entries_count(pInVideo);
+    for(int i = 0; i < numEntries; i++)
+    {
+        const AVIndexEntry* pEntry = avformat_index_get_entry(pInVideo, i);
+
+        if((pEntry->flags & AVINDEX_KEYFRAME) && pEntry->timestamp >= start && pEntry->timestamp <= end)
+            keyframes.push_back(pEntry->timestamp);
+    }
+
+    // first keyframe presented at or after the cut start and last one before the end
+    int64_t firstKeyPts = AV_NOPTS_VALUE;
+    int64_t lastKeyPts = AV_NOPTS_VALUE;
+
+    for(auto iter = keyframes.begin(); iter != keyframes.end() && firstKeyPts == AV_NOPTS_VALUE; iter++)
+    {
+        const int64_t pts = getKeyframePts(input, *iter);
+        if(pts != AV_NOPTS_VALUE && pts >= start && pts <= end)
+            firstKeyPts = pts;
+    }
+
+    // pieces reaching the end of the recording are copied completely, there is no partial GOP at the end
+    const AVRational frameDelta = av_inv_q(pInVideo->r_frame_rate);
+    const int64_t streamEnd = pInVideo->duration != AV_NOPTS_VALUE ? pInVideo->duration :
+                              av_rescale_q(input.pFormatContext->duration, AV_TIME_BASE_Q, timeBase);
+
+    if(streamEnd > 0 && end >= streamEnd - av_rescale_q(1, frameDelta, timeBase))
+        lastKeyPts = end;
+
+    for(auto iter = keyframes.rbegin(); iter != keyframes.rend() && lastKeyPts == AV_NOPTS_VALUE; iter++)
+    {
+        const int64_t pts = getKeyframePts(input, *iter);
+        if(pts != AV_NOPTS_VALUE && pts >= start && pts <= end)
+            lastKeyPts = pts;
+    }
+
+    const bool canCopy = firstKeyPts != AV_NOPTS_VALUE && lastKeyPts != AV_NOPTS_VALUE &&
+                         (lastKeyPts - firstKeyPts) * av_q2d(timeBase) >= MIN_COPY_DURATION_S;
+
+    LOG(INFO) << "Appending " << sourceFile << " [" << tStart_s << "s, " << tStart_s + duration_s << "s] at " << outStart_us_ * 1e-6 << "s"
+              << (canCopy ? ", copying " + std::to_string(firstKeyPts * av_q2d(timeBase)) + "s - " + std::to_string(lastKeyPts * av_q2d(timeBase)) + "s" : ", re-encoding");
+
+    bool success;
+
+    if(canCopy)
+    {
+        success = processRange(input, start, firstKeyPts, false) &&
+                  processRange(input, firstKeyPts, lastKeyPts, true) &&
+                  processRange(input, lastKeyPts, end, false);
+
+        copied_s_ += (lastKeyPts - firstKeyPts) * av_q2d(timeBase);
+        encoded_s_ += (end - start - (lastKeyPts - firstKeyPts)) * av_q2d(timeBase);
+    }
+    else
+    {
+        success = processRange(input, start, end, false);
+
+        encoded_s_ += (end - start) * av_q2d(timeBase);
+    }
+
+    closeInput(input);
+
+    outStart_us_ += (int64_t)(duration_s * 1e6);
+
+    return success;
+}
+
+bool MediaSmartRenderer::processRange(Input& input, int64_t from, int64_t to, bool copyVideo)
+{
+    int result;
+
+    if(from >= to)
+        return true;
+
+    AVStream* pInVideo = input.pVideoStream;
+    AVStream* pInAudio = input.pAudioStream;
+
+    const int64_t preRoll = av_rescale_q((int64_t)(SEEK_PREROLL_S * 1e6), AV_TIME_BASE_Q, pInVideo->time_base);
+
+    result = av_seek_frame(input.pFormatContext, pInVideo->index, std::max<int64_t>(from - preRoll, 0), AVSEEK_FLAG_BACKWARD);
+    if(result < 0)
+    {
+        LOG(ERROR) << "Seeking in source failed: " << err2str(result);
+        return false;
+    }
+
+    if(!copyVideo)
+    {
+        avcodec_flush_buffers(input.pDecoder);
+
+        if(!openEncoder(input))
+            return false;
+    }
+
+    const int64_t audioFrom = pInAudio ? av_rescale_q(from, pInVideo->time_base, pInAudio->time_base) : 0;
+    const int64_t audioTo = pInAudio ? av_rescale_q(to, pInVideo->time_base, pInAudio->time_base) : 0;
+
+    bool videoDone = false;
+    bool audioDone = pInAudio == nullptr;
+    bool copyStarted = false;
+    bool success = true;
+
+    AVPacketWrapper pPacket;
+    AVFrameWrapper pFrame;
+    std::vector<std::shared_ptr<AVPacketWrapper>> packets;
+
+    auto writePackets = [&]() -> bool
+    {
+        for(auto& pEncoded : packets)
+        {
+            if(!writePacket(*pEncoded, pVideoStream_, lastVideoDts_))
+                return false;
+        }
+
+        packets.clear();
+
+        return true;
+    };
+
+    // decodes pending frames and encodes those inside the range, returns false on errors
+    auto decodeFrames = [&]() -> bool
+    {
+        while(avcodec_receive_frame(input.pDecoder, pFrame) >= 0)
+        {
+            const int64_t pts = pFrame->best_effort_timestamp;
+
+            if(pts >= to)
+                videoDone = true;
+
+            if(videoDone || pts < from)
+            {
+                av_frame_unref(pFrame);
+                continue;
+            }
+
+            pFrame->pts = mapTimestamp(pts, pInVideo->time_base, pEncoder_->time_base);
+            pFrame->pict_type = AV_PICTURE_TYPE_NONE;
+
+            const bool encoded = encodeFrame(pFrame, packets);
+
+            av_frame_unref(pFrame);
+
+            if(!encoded || !writePackets())
+                return false;
+        }
+
+        return true;
+    };
+
+    while(!(videoDone && audioDone) && success)
+    {
+        if(shouldAbort_)
+        {
+            success = false;
+            break;
+        }
+
+        result = av_read_frame(input.pFormatContext, pPacket);
+        if(result == AVERROR_EOF)
+        {
+            if(!copyVideo && !videoDone)
+            {
+                avcodec_send_packet(input.pDecoder, nullptr);
+                success = decodeFrames();
+            }
+
+            break;
+        }
+        else if(result < 0)
+        {
+            LOG(ERROR) << "Reading source failed: " << err2str(result);
+            success = false;
+            break;
+        }
+
+        const int64_t pts = pPacket->pts != AV_NOPTS_VALUE ? pPacket->pts : pPacket->dts;
+
+        if(pInAudio && pPacket->stream_index == pInAudio->index && !audioDone)
+        {
+            if(pts >= audioTo)
+            {
+                audioDone = true;
+            }
+            else if(pts >= audioFrom)
+            {
+                av_packet_rescale_ts(pPacket, pInAudio->time_base, pAudioStream_->time_base);
+                pPacket->pts = mapTimestamp(pPacket->pts, pAudioStream_->time_base, pAudioStream_->time_base);
+                pPacket->dts = mapTimestamp(pPacket->dts, pAudioStream_->time_base, pAudioStream_->time_base);
+                pPacket->stream_index = pAudioStream_->index;
+                pPacket->pos = -1;
+
+                success = writePacket(pPacket, pAudioStream_, lastAudioDts_);
+            }
+        }
+        else if(pPacket->stream_index == pInVideo->index && !videoDone)
+        {
+            if(copyVideo)
+            {
+                const bool isKey = pPacket->flags & AV_PKT_FLAG_KEY;
+
+                if(isKey && pts >= to)
+                {
+                    videoDone = true;
+                }
+                else if((copyStarted || (isKey && pts >= from)) && pts >= from && pts < to)
+                {
+                    // the encoded frames before may have replaced the parameter sets of the source
+                    if(!copyStarted && !input.parameterSets.empty())
+                    {
+                        AVPacketWrapper pOut;
+                        av_new_packet(pOut, input.parameterSets.size() + pPacket->size);
+                        memcpy(pOut->data, input.parameterSets.data(), input.parameterSets.size());
+                        memcpy(pOut->data + input.parameterSets.size(), pPacket->data, pPacket->size);
+                        av_packet_copy_props(pOut, pPacket);
+                        av_packet_unref(pPacket);
+                        av_packet_move_ref(pPacket, pOut);
+                    }
+
+                    copyStarted = true;
+
+                    av_packet_rescale_ts(pPacket, pInVideo->time_base, pVideoStream_->time_base);
+                    pPacket->pts = mapTimestamp(pPacket->pts, pVideoStream_->time_base, pVideoStream_->time_base);
+                    pPacket->dts = mapTimestamp(pPacket->dts, pVideoStream_->time_base, pVideoStream_->time_base);
+                    pPacket->stream_index = pVideoStream_->index;
+                    pPacket->pos = -1;
+
+                    success = writePacket(pPacket, pVideoStream_, lastVideoDts_);
+                }
+            }
+            else
+            {
+                result = avcodec_send_packet(input.pDecoder, pPacket);
+                if(result < 0 && result != AVERROR(EAGAIN))
+                    LOG(WARNING) << "Decoding source packet failed: " << err2str(result);
+
+                success = decodeFrames();
+            }
+        }
+
+        av_packet_unref(pPacket);
+    }
+
+    if(!copyVideo)
+    {
+        if(success)
+            success = encodeFrame(nullptr, packets) && writePackets();
+
+        closeEncoder();
+    }
+
+    return success;
+}
+
+bool MediaSmartRenderer::openEncoder(const Input& input)
+{
+    int result;
+
+    const AVCodec* pCodec = avcodec_find_encoder_by_name("libx264");
+    if(!pCodec)
+    {
+        LOG(ERROR) << "libx264 encoder not found";
+        return false;
+    }
+
+    pEncoder_ = avcodec_alloc_context3(pCodec);
+
+    const AVCodecContext* pDecoder = input.pDecoder;
+    const AVStream* pInVideo = input.pVideoStream;
+
+    int64_t bitRate = pInVideo->codecpar->bit_rate;
+    if(bitRate <= 0)
+        bitRate = input.pFormatContext->bit_rate > 0 ? input.pFormatContext->bit_rate : 20000000;
+
+    pEncoder_->width = pDecoder->width;
+    pEncoder_->height = pDecoder->height;
+    pEncoder_->pix_fmt = pDecoder->pix_fmt;
+    pEncoder_->sample_aspect_ratio = pDecoder->sample_aspect_ratio;
+    pEncoder_->color_range = pDecoder->color_range;
+    pEncoder_->colorspace = pDecoder->colorspace;
+    pEncoder_->color_primaries = pDecoder->color_primaries;
+    pEncoder_->color_trc = pDecoder->color_trc;
+    pEncoder_->time_base = pVideoStream_->time_base;
+    pEncoder_->framerate = pInVideo->r_frame_rate;
+    pEncoder_->bit_rate = bitRate;
+    pEncoder_->max_b_frames = 0;
+    pEncoder_->thread_count = 0;
+
+    // stay within the limits the sample description announces
+    pEncoder_->profile = pInVideo->codecpar->profile & ~FF_PROFILE_H264_CONSTRAINED;
+    pEncoder_->level = pInVideo->codecpar->level;
+
+    // no global header: SPS and PPS are repeated in-band with every IDR frame
+    av_opt_set(pEncoder_->priv_data, "preset", "faster", 0);
+
+    result = avcodec_open2(pEncoder_, pCodec, NULL);
+    if(result < 0)
+    {
+        LOG(ERROR) << "Could not open boundary encoder: " << err2str(result);
+        avcodec_free_context(&pEncoder_);
+        return false;
+    }
+
+    return true;
+}
+
+void MediaSmartRenderer::closeEncoder()
+{
+    if(pEncoder_)
+        avcodec_free_context(&pEncoder_);
+
+    pEncoder_ = 0;
+}
+
+bool MediaSmartRenderer::encodeFrame(AVFrame* pFrame, std::vector<std::shared_ptr<AVPacketWrapper>>& packets)
+{
+    int result;
+
+    result = avcodec_send_frame(pEncoder_, pFrame);
+    if(result < 0)
+    {
+        LOG(ERROR) << "Sending frame to boundary encoder failed: " << err2str(result);
+        return false;
+    }
+
+    AVPacketWrapper pPacket;
+
+    while((result = avcodec_receive_packet(pEncoder_, pPacket)) >= 0)
+    {
+        // x264 writes Annex B, the MP4 stream expects length prefixed NAL units like the source
+        std::vector<uint8_t> data = annexBToLengthPrefixed(pPacket->data, pPacket->size);
+
+        auto pOut = std::make_shared<AVPacketWrapper>();
+        av_new_packet(*pOut, data.size());
+        memcpy((*pOut)->data, data.data(), data.size());
+        av_packet_copy_props(*pOut, pPacket);
+
+        av_packet_rescale_ts(*pOut, pEncoder_->time_base, pVideoStream_->time_base);
+        (*pOut)->stream_index = pVideoStream_->index;
+
+        av_packet_unref(pPacket);
+
+        packets.push_back(pOut);
+    }
+
+    if(result != AVERROR(EAGAIN) && result != AVERROR_EOF)
+    {
+        LOG(ERROR) << "Receiving packet from boundary encoder failed: " << err2str(result);
+        return false;
+    }
+
+    return true;
+}
+
+bool MediaSmartRenderer::appendFiller(const std::string& referenceFile, double duration_s)
+{
+    if(fillerVideo_.empty())
+    {
+        Input input;
+        if(!openInput(referenceFile, input))
+            return false;
+
+        if(!initialized_ && !initialize(input))
+        {
+            closeInput(input);
+            return false;
+        }
+
+        const bool success = createFiller(input);
+
+        closeInput(input);
+
+        if(!success)
+            return false;
+    }
+
+    LOG(INFO) << "Appending " << duration_s << "s filler at " << outStart_us_ * 1e-6 << "s";
+
+    const int64_t duration_us = (int64_t)(duration_s * 1e6);
+
+    // the filler GOP is repeated with shifted timestamps, the last repetition is cut short
+    for(int64_t offset_us = 0; offset_us < duration_us; offset_us += fillerDuration_us_)
+    {
+        if(shouldAbort_)
+            return false;
+
+        pieceStart_us_ = -offset_us;
+
+        const int64_t left_us = std::min(fillerDuration_us_, duration_us - offset_us);
+
+        for(auto pStream : { pVideoStream_, pAudioStream_ })
+        {
+            if(!pStream)
+                continue;
+
+            const auto& packets = pStream == pVideoStream_ ? fillerVideo_ : fillerAudio_;
+            int64_t& lastDts = pStream == pVideoStream_ ? lastVideoDts_ : lastAudioDts_;
+            const int64_t limit = av_rescale_q(left_us, AV_TIME_BASE_Q, pStream->time_base);
+
+            AVPacketWrapper pPacket;
+
+            for(const auto& pFiller : packets)
+            {
+                if((*pFiller)->pts < 0 || (*pFiller)->pts >= limit)
+                    continue;
+
+                av_packet_ref(pPacket, *pFiller);
+
+                pPacket->pts = mapTimestamp(pPacket->pts, pStream->time_base, pStream->time_base);
+                pPacket->dts = mapTimestamp(pPacket->dts, pStream->time_base, pStream->time_base);
+
+                const bool written = writePacket(pPacket, pStream, lastDts);
+
+                av_packet_unref(pPacket);
+
+                if(!written)
+                    return false;
+            }
+        }
+    }
+
+    outStart_us_ += duration_us;
+    filler_s_ += duration_s;
+
+    return true;
+}
+
+bool MediaSmartRenderer::createFiller(const Input& input)
+{
+    int result;
+
+    if(!openEncoder(input))
+        return false;
+
+    // intra and predicted frames only, any prefix of the GOP is decodable
+    const AVRational frameDelta = av_inv_q(input.pVideoStream->r_frame_rate);
+    const int numFrames = std::max(1, (int)(FILLER_DURATION_S / av_q2d(frameDelta) + 0.5));
+
+    fillerDuration_us_ = av_rescale_q(numFrames, frameDelta, AV_TIME_BASE_Q);
+
+    AVFrameWrapper pFrame;
+    pFrame->format = pEncoder_->pix_fmt;
+    pFrame->width = pEncoder_->width;
+    pFrame->height = pEncoder_->height;
+    pFrame->color_range = pEncoder_->color_range;
+
+    result = av_frame_get_buffer(pFrame, 0);
+    if(result < 0)
+    {
+        LOG(ERROR) << "Could not allocate filler frame: " << err2str(result);
+        closeEncoder();
+        return false;
+    }
+
+    ptrdiff_t linesizes[4];
+    for(int i = 0; i < 4; i++)
+        linesizes[i] = pFrame->linesize[i];
+
+    av_image_fill_black(pFrame->data, linesizes, pEncoder_->pix_fmt, pFrame->color_range, pFrame->width, pFrame->height);
+
+    bool success = true;
+
+    for(int i = 0; i < numFrames && success; i++)
+    {
+        pFrame->pts = av_rescale_q(i, frameDelta, pEncoder_->time_base);
+        success = encodeFrame(pFrame, fillerVideo_);
+    }
+
+    if(success)
+        success = encodeFrame(nullptr, fillerVideo_);
+
+    closeEncoder();
+
+    if(success && input.pAudioStream)
+        success = encodeSilence(input);
+
+    if(!success)
+    {
+        fillerVideo_.clear();
+        fillerAudio_.clear();
+        return false;
+    }
+
+    LOG(INFO) << "Created " << fillerDuration_us_ * 1e-6 << "s filler, video packets: " << fillerVideo_.size() << ", audio packets: " << fillerAudio_.size();
+
+    return true;
+}
+
+bool MediaSmartRenderer::encodeSilence(const Input& input)
+{
+    int result;
+
+    const AVCodecParameters* pParams = input.pAudioStream->codecpar;
+
+    const AVCodec* pCodec = avcodec_find_encoder(pParams->codec_id);
+    if(!pCodec)
+    {
+        LOG(ERROR) << "No encoder for audio of the source";
+        return false;
+    }
+
+    AVCodecContext* pContext = avcodec_alloc_context3(pCodec);
+
+    pContext->sample_fmt = pCodec->sample_fmts ? pCodec->sample_fmts[0] : AV_SAMPLE_FMT_FLTP;
+    pContext->sample_rate = pParams->sample_rate;
+    pContext->channels = pParams->channels;
+    pContext->channel_layout = pParams->channel_layout ? pParams->channel_layout : av_get_default_channel_layout(pParams->channels);
+    pContext->bit_rate = pParams->bit_rate > 0 ? pParams->bit_rate : 128000;
+    pContext->time_base = AVRational{ 1, pParams->sample_rate };
+
+    result = avcodec_open2(pContext, pCodec, NULL);
+    if(result < 0)
+    {
+        LOG(ERROR) << "Could not open filler audio encoder: " << err2str(result);
+        avcodec_free_context(&pContext);
+        return false;
+    }
+
+    const int frameSize = pContext->frame_size > 0 ? pContext->frame_size : 1024;
+    const int64_t numSamples = av_rescale_q(fillerDuration_us_, AV_TIME_BASE_Q, pContext->time_base);
+
+    AVFrameWrapper pFrame;
+    pFrame->format = pContext->sample_fmt;
+    pFrame->channels = pContext->channels;
+    pFrame->channel_layout = pContext->channel_layout;
+    pFrame->sample_rate = pContext->sample_rate;
+    pFrame->nb_samples = frameSize;
+
+    result = av_frame_get_buffer(pFrame, 0);
+    if(result < 0)
+    {
+        LOG(ERROR) << "Could not allocate filler audio frame: " << err2str(result);
+        avcodec_free_context(&pContext);
+        return false;
+    }
+
+    av_samples_set_silence(pFrame->data, 0, frameSize, pContext->channels, pContext->sample_fmt);
+
+    AVPacketWrapper pPacket;
+    bool success = true;
+
+    // one frame more than needed, the encoder delay shifts the output
+    for(int64_t sample = 0; sample <= numSamples + frameSize && success; sample += frameSize)
+    {
+        pFrame->pts = sample;
+
+        AVFrame* pInput = sample <= numSamples ? (AVFrame*)pFrame : nullptr;
+
+        result = avcodec_send_frame(pContext, pInput);
+        if(result < 0)
+        {
+            LOG(ERROR) << "Sending frame to filler audio encoder failed: " << err2str(result);
+            success = false;
+            break;
+        }
+
+        while((result = avcodec_receive_packet(pContext, pPacket)) >= 0)
+        {
+            av_packet_rescale_ts(pPacket, pContext->time_base, pAudioStream_->time_base);
+            pPacket->stream_index = pAudioStream_->index;
+
+            auto pOut = std::make_shared<AVPacketWrapper>();
+            av_packet_move_ref(*pOut, pPacket);
+
+            fillerAudio_.push_back(pOut);
+        }
+
+        if(result != AVERROR(EAGAIN) && result != AVERROR_EOF)
+        {
+            LOG(ERROR) << "Receiving packet from filler audio encoder failed: " << err2str(result);
+            success = false;
+        }
+    }
+
+    avcodec_free_context(&pContext);
+
+    return success;
+}
+
+int64_t MediaSmartRenderer::mapTimestamp(int64_t ts, AVRational inTimeBase, AVRational outTimeBase) const
+{
+    if(ts == AV_NOPTS_VALUE)
+        return ts;
+
+    return av_rescale_q(ts, inTimeBase, outTimeBase) + av_rescale_q(outStart_us_ - pieceStart_us_, AV_TIME_BASE_Q, outTimeBase);
+}
+
+bool MediaSmartRenderer::writePacket(AVPacket* pPacket, AVStream* pOutStream, int64_t& lastDts)
+{
+    int result;
+
+    // encoded boundary frames have no reordering delay, copied GOPs after them may start with a lower DTS
+    if(pPacket->dts != AV_NOPTS_VALUE && lastDts != AV_NOPTS_VALUE && pPacket->dts <= lastDts)
+    {
+        if(pPacket->pts != AV_NOPTS_VALUE && lastDts + 1 <= pPacket->pts)
+        {
+            pPacket->dts = lastDts + 1;
+        }
+        else
+        {
+            LOG_IF(debug_, INFO) << "Dropping overlapping packet, stream: " << pOutStream->index << ", DTS: " << pPacket->dts;
+            return true;
+        }
+    }
+
+    if(pPacket->dts != AV_NOPTS_VALUE)
+        lastDts = pPacket->dts;
+
+    result = av_interleaved_write_frame(pFormatContext_, pPacket);
+    if(result < 0)
+    {
+        LOG(ERROR) << "Error while writing packet: " << err2str(result);
+        return false;
+    }
+
+    return true;
+}
+
+std::vector<uint8_t> MediaSmartRenderer::annexBToLengthPrefixed(const uint8_t* pData, int size)
+{
+    std::vector<uint8_t> out;
+    out.reserve(size + 16);
+
+    auto appendNal = [&](int begin, int end)
+    {
+        // also strips the leading zero of 4 byte start codes
+        while(end > begin && pData[end-1] == 0)
+            end--;
+
+        const int length = end - begin;
+        if(length <= 0)
+            return;
+
+        out.push_back((length >> 24) & 0xFF);
+        out.push_back((length >> 16) & 0xFF);
+        out.push_back((length >> 8) & 0xFF);
+        out.push_back(length & 0xFF);
+        out.insert(out.end(), pData + begin, pData + end);
+    };
+
+    int nalStart = -1;
+    int i = 0;
+
+    while(i + 2 < size)
+    {
+        if(pData[i] == 0 && pData[i+1] == 0 && pData[i+2] == 1)
+        {
+            if(nalStart >= 0)
+                appendNal(nalStart, i);
+
+            i += 3;
+            nalStart = i;
+        }
+        else
+        {
+            i++;
+        }
+    }
+
+    if(nalStart >= 0)
+        appendNal(nalStart, size);
+
+    return out;
+}
+
+bool MediaSmartRenderer::close()
+{
+    int result;
+    bool success = true;
+
+    closeEncoder();
+
+    if(initialized_)
+    {
+        result = av_write_trailer(pFormatContext_);
+        if(result < 0)
+        {
+            LOG(ERROR) << "Writing trailer failed: " << err2str(result);
+            success = false;
+        }
+
+        if(pFileWriter_ && pFileWriter_->close() < 0)
+            success = false;
+
+        LOG(INFO) << "Smart rendered " << filename_ << ", copied: " << copied_s_ << "s, encoded: " << encoded_s_ << "s, filler: " << filler_s_ << "s";
+    }
+
+    if(pFormatContext_)
+        avformat_free_context(pFormatContext_);
+
+    pFileWriter_.reset();
+
+    initialized_ = false;
+    pFormatContext_ = 0;
+    pVideoStream_ = 0;
+    pAudioStream_ = 0;
+
+    return success;
+}
+
+std::string MediaSmartRenderer::err2str(int errnum)
+{
+    std::string msg(AV_ERROR_MAX_STRING_SIZE, 0);
+
+    av_strerror(errnum, msg.data(), msg.size());
+
+    return msg;
+}
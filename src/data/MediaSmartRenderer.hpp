@@ -0,0 +1,102 @@
+#pragma once
+
+#include "AVWrapper.hpp"
+#include "FileWriter.hpp"
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Writes pieces of H.264 recordings into one file without decoding complete GOPs.
+// Only the frames between a cut and the next keyframe (or the last keyframe and the
+// end of the piece) are re-encoded, everything else including audio is copied.
+// The output is tagged avc3, every GOP carries its own SPS and PPS in-band.
+class MediaSmartRenderer
+{
+public:
+    MediaSmartRenderer(std::string filename, const std::atomic<bool>& shouldAbort);
+    ~MediaSmartRenderer();
+
+    // packets of all sources must be valid in one output stream
+    static bool isCompatible(const std::vector<std::string>& sourceFiles);
+
+    // presentation time of the last keyframe at or before t_s, negative if there is none
+    static double findKeyframe_s(const std::string& sourceFile, double t_s);
+
+    void useFragments(bool enable) { fragmented_ = enable; }
+
+    bool append(const std::string& sourceFile, double tStart_s, double duration_s);
+
+    // black and silent filler, encoded once in the format of the reference file and repeated
+    bool appendFiller(const std::string& referenceFile, double duration_s);
+
+    bool close();
+
+    double getCopiedDuration_s() const { return copied_s_; }
+    double getEncodedDuration_s() const { return encoded_s_; }
+    double getFillerDuration_s() const { return filler_s_; }
+
+    // shorter copy ranges are not worth the additional encoder start
+    static constexpr double MIN_COPY_DURATION_S = 2.0;
+    static constexpr double SEEK_PREROLL_S = 1.0;
+    static constexpr double FILLER_DURATION_S = 1.0;
+
+private:
+    struct Input
+    {
+        AVFormatContext* pFormatContext = nullptr;
+        AVStream* pVideoStream = nullptr;
+        AVStream* pAudioStream = nullptr;
+        AVCodecContext* pDecoder = nullptr;
+
+        // SPS and PPS from avcC, converted to length prefixed NAL units
+        std::vector<uint8_t> parameterSets;
+    };
+
+    static bool openInput(const std::string& filename, Input& input);
+    static void closeInput(Input& input);
+    static int64_t getKeyframePts(Input& input, int64_t dts);
+
+    bool initialize(const Input& input);
+    bool processRange(Input& input, int64_t from, int64_t to, bool copyVideo);
+    bool openEncoder(const Input& input);
+    void closeEncoder();
+    bool encodeFrame(AVFrame* pFrame, std::vector<std::shared_ptr<AVPacketWrapper>>& packets);
+    bool createFiller(const Input& input);
+    bool encodeSilence(const Input& input);
+
+    int64_t mapTimestamp(int64_t ts, AVRational inTimeBase, AVRational outTimeBase) const;
+    bool writePacket(AVPacket* pPacket, AVStream* pOutStream, int64_t& lastDts);
+
+    static std::vector<uint8_t> annexBToLengthPrefixed(const uint8_t* pData, int size);
+    static std::string err2str(int errnum);
+
+    bool debug_;
+    std::string filename_;
+    const std::atomic<bool>& shouldAbort_;
+    bool initialized_;
+    bool fragmented_;
+
+    AVFormatContext* pFormatContext_;
+    std::unique_ptr<FileWriter> pFileWriter_;
+    AVStream* pVideoStream_;
+    AVStream* pAudioStream_;
+    AVCodecContext* pEncoder_;
+
+    int64_t lastVideoDts_;
+    int64_t lastAudioDts_;
+
+    // piece currently appended, source time pieceStart_us_ is written at outStart_us_
+    int64_t pieceStart_us_;
+    int64_t outStart_us_;
+
+    // one filler GOP, timestamps relative to its start in output stream time base
+    std::vector<std::shared_ptr<AVPacketWrapper>> fillerVideo_;
+    std::vector<std::shared_ptr<AVPacketWrapper>> fillerAudio_;
+    int64_t fillerDuration_us_;
+
+    double copied_s_;
+    double encoded_s_;
+    double filler_s_;
+};
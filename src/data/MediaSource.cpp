@@ -1,6 +1,11 @@
 #include "MediaSource.hpp"
+#include "FrameCacheManager.hpp"
+#include "MediaWorkerPool.hpp"
 #include "util/easylogging++.h"
 #include <iomanip>
+#include <cmath>
+#include <filesystem>
+#include <algorithm>
 
 extern "C" {
 #include <libavutil/channel_layout.h>
@@ -24,21 +29,44 @@ enum AVPixelFormat MediaSource::internalGetHwFormat(AVCodecContext *ctx, const e
     return AV_PIX_FMT_NONE;
 }
 
-MediaSource::MediaSource(std::string filename, bool useHwDecoder, std::string hwDecoder)
+MediaSource::MediaSource(std::string filename, bool useHwDecoder, std::string hwDecoder, Usage usage)
 :lastRequestTime_s_(0.0),
+ lastAccessTime_(std::chrono::steady_clock::now().time_since_epoch().count()),
  debug_(false),
  isLoaded_(false),
  filename_(filename),
+ usage_(usage),
+ isProxy_(false),
+ isScheduled_(false),
+ codecsOpened_(false),
+ codecsFailed_(false),
+ dataVersion_(0),
  runPreloaderThread_(true),
  reachedEndOfFile_(false),
  pFormatContext_(0),
  pVideoCodecContext_(0),
  pAudioCodecContext_(0),
  pHwDeviceContext_(0),
- hwPixFormat_(AV_PIX_FMT_NONE)
+ pPreviewScaler_(0),
+ pVideoHWConfig_(0),
+ hwPixFormat_(AV_PIX_FMT_NONE),
+ videoSamplesBytes_(0),
+ videoFrameBytes_(0),
+ playbackSpeed_(0.0),
+ speedSampleTime_s_(0.0),
+ speedSampleWallTime_(std::chrono::steady_clock::now()),
+ trickPlay_(false),
+ trickPlayActive_(false),
+ forceSeek_(false),
+ preRollEndPts_(AV_NOPTS_VALUE),
+ lastJumpTime_(0),
+ scrubTime_s_(-1.0),
+ prefetchStart_s_(-1.0)
 {
     int result;
 
+    FrameCacheManager::getInstance().registerSource(this);
+
     LOG(INFO) << "Trying to load media source: " << filename;
 
     enum AVHWDeviceType type = AV_HWDEVICE_TYPE_NONE;
@@ -46,7 +74,7 @@ MediaSource::MediaSource(std::string filename, bool useHwDecoder, std::string hw
     while((type = av_hwdevice_iterate_types(type)) != AV_HWDEVICE_TYPE_NONE)
         LOG_IF(debug_, INFO) << "AV_HWDEVICE support: " << av_hwdevice_get_type_name(type);
 
-    // Open container format
+    // Open container format, codecs are opened on first use
     pFormatContext_ = avformat_alloc_context();
     if(!pFormatContext_)
     {
@@ -54,16 +82,37 @@ MediaSource::MediaSource(std::string filename, bool useHwDecoder, std::string hw
         return;
     }
 
-    result = avformat_open_input(&pFormatContext_, filename.c_str(), NULL, NULL);
+    // Previews use a low resolution proxy if one has been generated
+    std::string openFilename = filename;
+
+    if(usage_ == Usage::PREVIEW && std::filesystem::exists(getProxyFilename(filename)))
+    {
+        openFilename = getProxyFilename(filename);
+        isProxy_ = true;
+
+        LOG(INFO) << "Using proxy: " << openFilename;
+    }
+
+    // exports read each file once, keep them out of the page cache
+    pFileReader_ = std::make_unique<FileReader>();
+    pFileReader_->useDirectIO(usage_ == Usage::EXPORT);
+    pFileReader_->useSequentialHint(usage_ == Usage::EXPORT);
+
+    if(pFileReader_->open(openFilename))
+        pFormatContext_->pb = pFileReader_->getAVIOContext();
+    else
+        pFileReader_.reset();
+
+    result = avformat_open_input(&pFormatContext_, openFilename.c_str(), NULL, NULL);
     if(result)
     {
-        LOG(ERROR) << "Could not open video file: " << filename << ", result: " << err2str(result);
+        LOG(ERROR) << "Could not open video file: " << openFilename << ", result: " << err2str(result);
         return;
     }
 
     LOG(INFO) << "Video format " << pFormatContext_->iformat->name << ", duration " << pFormatContext_->duration << "us";
 
-    // Find best video stream and setup codec
+    // Find best video stream
     int streamNumber = av_find_best_stream(pFormatContext_, AVMEDIA_TYPE_VIDEO, -1, -1, &pVideoCodec_, 0);
     if(streamNumber < 0)
     {
@@ -95,8 +144,6 @@ MediaSource::MediaSource(std::string filename, bool useHwDecoder, std::string hw
         LOG(INFO) << "    " << pDictEntry->key << " = " << pDictEntry->value;
     }
 
-    const AVCodecHWConfig* pVideoHWConfig = 0;
-
     if(useHwDecoder)
     {
         type = av_hwdevice_find_type_by_name(hwDecoder.c_str());
@@ -113,7 +160,7 @@ MediaSource::MediaSource(std::string filename, bool useHwDecoder, std::string hw
                 LOG(INFO) << "[" << index << "] Supported HW: " << av_hwdevice_get_type_name(pConfig->device_type) << ", pixfmt: " << pConfig->pix_fmt;
             }
 
-            pVideoHWConfig = pConfig; // we will just use the last config if none was specified
+            pVideoHWConfig_ = pConfig; // we will just use the last config if none was specified
 
             if(type != AV_HWDEVICE_TYPE_NONE && pConfig->device_type == type)
                 break;
@@ -121,119 +168,213 @@ MediaSource::MediaSource(std::string filename, bool useHwDecoder, std::string hw
             index++;
         }
 
-        if(!pVideoHWConfig)
+        if(!pVideoHWConfig_)
         {
             LOG(ERROR) << "No hardware decoding support available";
             return;
         }
 
-        LOG(INFO) << "Selected HW: " << av_hwdevice_get_type_name(pVideoHWConfig->device_type);
+        LOG(INFO) << "Selected HW: " << av_hwdevice_get_type_name(pVideoHWConfig_->device_type);
     }
 
+    // Find best audio stream
+    streamNumber = av_find_best_stream(pFormatContext_, AVMEDIA_TYPE_AUDIO, -1, -1, &pAudioCodec_, 0);
+    if(streamNumber < 0)
+    {
+        LOG(ERROR) << "Could retrieve audio stream. Result: " << err2str(streamNumber);
+        return;
+    }
+
+    pAudioStream_ = pFormatContext_->streams[streamNumber];
+    AVCodecParameters* pAudioCodecPars = pAudioStream_->codecpar;
+
+    duration_s = (float)pAudioStream_->duration * pAudioStream_->time_base.num / pAudioStream_->time_base.den;
+
+    LOG(INFO) << "Codec pars. Channels: " << pAudioCodecPars->channels << ", layout: 0x" << std::hex << pAudioCodecPars->channel_layout << std::dec << ", sample rate: " << pAudioCodecPars->sample_rate;
+    LOG(INFO) << "Audio codec: " << pAudioCodec_->name << ", bitrate: " << pAudioCodecPars->bit_rate << ", bits per raw sample: " << pAudioCodecPars->bits_per_raw_sample;
+    LOG(INFO) << "Duration: " << std::setprecision(6) << duration_s << ", startTime: " << pAudioStream_->start_time << "pts";
+    LOG(INFO) << "Time base: " << pAudioStream_->time_base.num << "/" << pAudioStream_->time_base.den;
+
+    audioPtsInc_ = pAudioStream_->time_base.den / (pAudioStream_->time_base.num * pAudioCodecPars->sample_rate);
+
+    packetCache_.setup(pFormatContext_, usage_ == Usage::PREVIEW ? PACKET_CACHE_SIZE : 0);
+
+    // read ahead only runs while the source is active, idle recordings keep no thread and buffers
+    if(pFileReader_)
+        pFileReader_->suspend();
+
+    isLoaded_ = true;
+}
+
+MediaSource::~MediaSource()
+{
+    runPreloaderThread_ = false;
+
+    if(preloaderThread_.joinable())
+        preloaderThread_.join();
+
+    MediaWorkerPool::getInstance().remove(this);
+
+    FrameCacheManager::getInstance().unregisterSource(this);
+
+    if(pFormatContext_)
+        avformat_close_input(&pFormatContext_);
+
+    if(pVideoCodecContext_)
+        avcodec_free_context(&pVideoCodecContext_);
+
+    if(pAudioCodecContext_)
+        avcodec_free_context(&pAudioCodecContext_);
+
+    if(pHwDeviceContext_)
+        av_buffer_unref(&pHwDeviceContext_);
+
+    if(pPreviewScaler_)
+        sws_freeContext(pPreviewScaler_);
+}
+
+bool MediaSource::openCodecs()
+{
+    int result;
+
+    LOG(INFO) << "Opening codecs for: " << filename_;
+
+    // Setup video codec
     pVideoCodecContext_ = avcodec_alloc_context3(pVideoCodec_);
     if(!pVideoCodecContext_)
     {
         LOG(ERROR) << "Video: No memory for AVCodecContext";
-        return;
+        return false;
     }
 
-    result = avcodec_parameters_to_context(pVideoCodecContext_, pVideoCodecPars);
+    result = avcodec_parameters_to_context(pVideoCodecContext_, pVideoStream_->codecpar);
     if(result < 0)
     {
         LOG(ERROR) << "Video: Failed to copy codec parameters to codec context. Result: " << err2str(result);
-        return;
+        return false;
     }
 
-    if(useHwDecoder)
+    if(pVideoHWConfig_)
     {
-        hwPixFormat_ = pVideoHWConfig->pix_fmt;
+        hwPixFormat_ = pVideoHWConfig_->pix_fmt;
         pVideoCodecContext_->opaque = this;
         pVideoCodecContext_->get_format = &getHwFormat;
 
-        result = av_hwdevice_ctx_create(&pHwDeviceContext_, pVideoHWConfig->device_type, NULL, NULL, 0);
+        result = av_hwdevice_ctx_create(&pHwDeviceContext_, pVideoHWConfig_->device_type, NULL, NULL, 0);
         if(result < 0)
         {
             LOG(ERROR) << "Failed to create specified HW device.";
-            return;
+            return false;
         }
 
         pVideoCodecContext_->hw_device_ctx = av_buffer_ref(pHwDeviceContext_);
     }
 
-    result = avcodec_open2(pVideoCodecContext_, pVideoCodec_, NULL);
-    if(result < 0)
+    if(usage_ == Usage::PREVIEW)
     {
-        LOG(ERROR) << "Video: Failed to open codec through avcodec_open2. Result: " << err2str(result);
-        return;
+        // trade some quality for decoding speed
+        pVideoCodecContext_->flags2 |= AV_CODEC_FLAG2_FAST;
+        pVideoCodecContext_->skip_loop_filter = AVDISCARD_NONREF;
     }
 
-    // Find best audio stream and setup codec
-    streamNumber = av_find_best_stream(pFormatContext_, AVMEDIA_TYPE_AUDIO, -1, -1, &pAudioCodec_, 0);
-    if(streamNumber < 0)
+    result = avcodec_open2(pVideoCodecContext_, pVideoCodec_, NULL);
+    if(result < 0)
     {
-        LOG(ERROR) << "Could retrieve audio stream. Result: " << err2str(streamNumber);
-        return;
+        LOG(ERROR) << "Video: Failed to open codec through avcodec_open2. Result: " << err2str(result);
+        return false;
     }
 
-    pAudioStream_ = pFormatContext_->streams[streamNumber];
-    AVCodecParameters* pAudioCodecPars = pAudioStream_->codecpar;
-
+    // Setup audio codec
     pAudioCodecContext_ = avcodec_alloc_context3(pAudioCodec_);
     if(!pAudioCodecContext_)
     {
         LOG(ERROR) << "Audio: No memory for AVCodecContext";
-        return;
+        return false;
     }
 
-    result = avcodec_parameters_to_context(pAudioCodecContext_, pAudioCodecPars);
+    result = avcodec_parameters_to_context(pAudioCodecContext_, pAudioStream_->codecpar);
     if(result < 0)
     {
         LOG(ERROR) << "Audio: Failed to copy codec parameters to codec context. Result: " << err2str(result);
-        return;
+        return false;
     }
 
     result = avcodec_open2(pAudioCodecContext_, pAudioCodec_, NULL);
     if(result < 0)
     {
         LOG(ERROR) << "Audio: Failed to open codec through avcodec_open2. Result: " << err2str(result);
-        return;
+        return false;
     }
 
-    duration_s = (float)pAudioStream_->duration * pAudioStream_->time_base.num / pAudioStream_->time_base.den;
-
     LOG(INFO) << "Context. Sample rate: " << pAudioCodecContext_->sample_rate << ", channels: " << pAudioCodecContext_->channels << ", bytes per sample: "
                     << av_get_bytes_per_sample(pAudioCodecContext_->sample_fmt) << ", planar: " << av_sample_fmt_is_planar(pAudioCodecContext_->sample_fmt);
 
-    LOG(INFO) << "Codec pars. Channels: " << pAudioCodecPars->channels << ", layout: 0x" << std::hex << pAudioCodecPars->channel_layout << std::dec << ", sample rate: " << pAudioCodecPars->sample_rate;
-    LOG(INFO) << "Audio codec: " << pAudioCodec_->name << ", bitrate: " << pAudioCodecPars->bit_rate << ", bits per raw sample: " << pAudioCodecPars->bits_per_raw_sample;
-    LOG(INFO) << "Duration: " << std::setprecision(6) << duration_s << ", startTime: " << pAudioStream_->start_time << "pts";
-    LOG(INFO) << "Time base: " << pAudioStream_->time_base.num << "/" << pAudioStream_->time_base.den;
+    return true;
+}
 
-    audioPtsInc_ = pAudioStream_->time_base.den / (pAudioStream_->time_base.num * pAudioCodecContext_->sample_rate);
+void MediaSource::activate()
+{
+    lastAccessTime_ = std::chrono::steady_clock::now().time_since_epoch().count();
 
-    preloaderThread_ = std::thread(&MediaSource::preloader, this);
+    if(!isLoaded_)
+        return;
 
-    isLoaded_ = true;
+    // parallel export jobs must not compete with each other and the GUI for the few pool threads
+    if(usage_ == Usage::EXPORT)
+    {
+        if(!preloaderThread_.joinable())
+            preloaderThread_ = std::thread(&MediaSource::preloader, this);
+
+        return;
+    }
+
+    if(!isScheduled_)
+        MediaWorkerPool::getInstance().activate(this);
 }
 
-MediaSource::~MediaSource()
+void MediaSource::preloader()
 {
-    runPreloaderThread_ = false;
+    while(runPreloaderThread_)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
 
-    if(preloaderThread_.joinable())
-        preloaderThread_.join();
+        if(!runPreloaderThread_)
+            return;
 
-    if(pFormatContext_)
-        avformat_close_input(&pFormatContext_);
+        preload();
+    }
+}
 
-    if(pVideoCodecContext_)
-        avcodec_free_context(&pVideoCodecContext_);
+void MediaSource::deactivate()
+{
+    // called by MediaWorkerPool for idle sources, never concurrently to preload
+    packetCache_.clear();
 
-    if(pAudioCodecContext_)
-        avcodec_free_context(&pAudioCodecContext_);
+    // the demuxer position does not match the cache anymore
+    forceSeek_ = true;
 
-    if(pHwDeviceContext_)
-        av_buffer_unref(&pHwDeviceContext_);
+    if(pFileReader_)
+        pFileReader_->suspend();
+}
+
+FileReaderStats MediaSource::getFileStats() const
+{
+    if(!pFileReader_)
+        return FileReaderStats { 0 };
+
+    return pFileReader_->getStats();
+}
+
+std::chrono::steady_clock::duration MediaSource::getIdleTime() const
+{
+    return std::chrono::steady_clock::now().time_since_epoch() - std::chrono::steady_clock::duration(lastAccessTime_);
+}
+
+std::string MediaSource::getProxyFilename(const std::string& filename)
+{
+    std::filesystem::path path(filename);
+
+    return (path.parent_path() / (path.stem().string() + ".proxy.mp4")).string();
 }
 
 double MediaSource::getDuration_s() const
@@ -247,7 +388,36 @@ void MediaSource::seekTo(double time_s)
     time_s = std::min(tMax, time_s);
     time_s = std::max(0.0, time_s);
 
+    updatePlaybackSpeed(time_s);
+
+    if(std::fabs(time_s - lastRequestTime_s_) > videoFrameDeltaTime_s_ * 5)
+        lastJumpTime_ = std::chrono::steady_clock::now().time_since_epoch().count();
+
     lastRequestTime_s_ = time_s;
+
+    FrameCacheManager::getInstance().touch(this);
+
+    activate();
+}
+
+void MediaSource::updatePlaybackSpeed(double time_s)
+{
+    const auto tNow = std::chrono::steady_clock::now();
+    const double dtWall_s = std::chrono::duration_cast<std::chrono::microseconds>(tNow - speedSampleWallTime_).count() * 1e-6;
+
+    if(dtWall_s < 0.05)
+        return;
+
+    double speed = (time_s - speedSampleTime_s_) / dtWall_s;
+
+    // large jumps are seeks, not playback
+    if(std::fabs(speed) > 64.0 || dtWall_s > 1.0)
+        speed = 0.0;
+
+    playbackSpeed_ = 0.7 * playbackSpeed_ + 0.3 * speed;
+
+    speedSampleTime_s_ = time_s;
+    speedSampleWallTime_ = tNow;
 }
 
 void MediaSource::seekToNext()
@@ -264,12 +434,19 @@ std::shared_ptr<MediaFrame> MediaSource::get()
 {
     int result;
 
+    if(!isLoaded_ || codecsFailed_)
+        return nullptr;
+
     auto pMediaFrame = std::make_shared<MediaFrame>();
 
     pMediaFrame->videoTimeBase = pVideoStream_->time_base;
     pMediaFrame->videoFramerate = pVideoStream_->r_frame_rate;
-    pMediaFrame->videoCodec = pVideoCodecContext_->codec_id;
-    pMediaFrame->videoBitRate = pVideoCodecContext_->bit_rate;
+    pMediaFrame->videoCodec = pVideoStream_->codecpar->codec_id;
+    pMediaFrame->videoBitRate = pVideoStream_->codecpar->bit_rate;
+
+    FrameCacheManager::getInstance().touch(this);
+
+    activate();
 
     int64_t requestPts = videoSecondsToPts(lastRequestTime_s_);
     requestPts = ((requestPts + videoPtsInc_/2)/videoPtsInc_) * videoPtsInc_;
@@ -277,16 +454,25 @@ std::shared_ptr<MediaFrame> MediaSource::get()
     {
         std::lock_guard<std::mutex> lock(videoSamplesMutex_);
 
-        const auto& iterVideo = videoSamples_.lower_bound(requestPts);
+        auto iterVideo = videoSamples_.lower_bound(requestPts);
+
+        // trick play and previews show the last frame before the requested time (e.g. a keyframe) if the exact one is missing
+        const bool exactFrameMissing = iterVideo == videoSamples_.end() || iterVideo->first >= requestPts + videoPtsInc_;
+        if((trickPlay_ || usage_ == Usage::PREVIEW) && exactFrameMissing && iterVideo != videoSamples_.begin())
+            iterVideo--;
+
         if(iterVideo == videoSamples_.end())
             return nullptr;
 
         pMediaFrame->pImage = iterVideo->second;
     }
 
+    if(trickPlay_)
+        return pMediaFrame;
+
     pMediaFrame->audioTimeBase = pAudioStream_->time_base;
-    pMediaFrame->audioCodec = pAudioCodecContext_->codec_id;
-    pMediaFrame->audioBitRate = pAudioCodecContext_->bit_rate;
+    pMediaFrame->audioCodec = pAudioStream_->codecpar->codec_id;
+    pMediaFrame->audioBitRate = pAudioStream_->codecpar->bit_rate;
 
     double tRequest_s = videoPtsToSeconds(requestPts);
 
@@ -296,29 +482,25 @@ std::shared_ptr<MediaFrame> MediaSource::get()
     {
         std::lock_guard<std::mutex> lock(audioSamplesMutex_);
 
-        auto iterAudioMin = audioSamples_.upper_bound(audioPtsMin);
-        if(iterAudioMin == audioSamples_.end())
-            return nullptr;
-
-        if(iterAudioMin != audioSamples_.begin())
-            iterAudioMin--;
+        const int64_t firstSample = audioPtsMin / audioPtsInc_;
+        const int numSamples = (audioPtsMax - audioPtsMin) / audioPtsInc_;
 
-        const auto iterAudioMax = audioSamples_.lower_bound(audioPtsMax);
-
-        const AVFrame* pFirstSrcFrame = *iterAudioMin->second;
+        // audio must be complete, unless the file ends early
+        const bool audioMissing = audioBuffer_.empty() || audioBuffer_.getFirstSample() > firstSample ||
+                                  (audioBuffer_.getEndSample() < firstSample + numSamples && !reachedEndOfFile_);
+        if(audioMissing)
+            return usage_ == Usage::PREVIEW ? pMediaFrame : nullptr;
 
         auto pWrapper = std::make_shared<AVFrameWrapper>();
         AVFrame* pFrame = *pWrapper;
 
-        pFrame->nb_samples = (audioPtsMax - audioPtsMin) / audioPtsInc_;
-        pFrame->format = pFirstSrcFrame->format;
-        pFrame->sample_rate = pFirstSrcFrame->sample_rate;
+        pFrame->nb_samples = numSamples;
+        pFrame->format = audioBuffer_.getFormat();
+        pFrame->sample_rate = audioBuffer_.getSampleRate();
+        pFrame->channel_layout = audioBuffer_.getChannelLayout();
+        pFrame->channels = audioBuffer_.getChannels();
         pFrame->pts = audioPtsMin;
 
-        pFrame->channel_layout = pFirstSrcFrame->channel_layout;
-        if(pFrame->channel_layout == 0)
-            pFrame->channel_layout = av_get_default_channel_layout(pFirstSrcFrame->channels);
-
         result = av_frame_get_buffer(pFrame, 0);
         if(result < 0)
         {
@@ -326,28 +508,44 @@ std::shared_ptr<MediaFrame> MediaSource::get()
             return nullptr;
         }
 
-        int samplesLeft = pFrame->nb_samples;
-        int64_t startPts = audioPtsMin;
-        int dstOffset = 0;
+        audioBuffer_.read(pFrame, firstSample);
 
-        for(auto iter = iterAudioMin; iter != iterAudioMax; iter++)
-        {
-            int srcOffset = (startPts - iter->first) / audioPtsInc_;
-            int copySize = (*iter->second)->nb_samples - srcOffset;
-            if(copySize > samplesLeft)
-                copySize = samplesLeft;
+        pMediaFrame->pSamples = pWrapper;
+    }
+
+    return pMediaFrame;
+}
 
-            av_samples_copy(pFrame->data, (*iter->second)->data, dstOffset, srcOffset, copySize, (*iter->second)->channels, (enum AVSampleFormat)pFrame->format);
+std::shared_ptr<MediaFrame> MediaSource::waitForFrame(std::chrono::milliseconds maxWait)
+{
+    const auto tEnd = std::chrono::steady_clock::now() + maxWait;
 
-            samplesLeft -= copySize;
-            dstOffset += copySize;
-            startPts += copySize * audioPtsInc_;
+    while(true)
+    {
+        uint64_t version;
+        {
+            std::lock_guard<std::mutex> lock(dataMutex_);
+            version = dataVersion_;
         }
 
-        pMediaFrame->pSamples = pWrapper;
+        auto pFrame = get();
+        if(pFrame || reachedEndOfFile_ || codecsFailed_)
+            return pFrame;
+
+        std::unique_lock<std::mutex> lock(dataMutex_);
+        if(!dataCv_.wait_until(lock, tEnd, [&]() { return dataVersion_ != version; }))
+            return nullptr;
     }
+}
 
-    return pMediaFrame;
+void MediaSource::notifyData()
+{
+    {
+        std::lock_guard<std::mutex> lock(dataMutex_);
+        dataVersion_++;
+    }
+
+    dataCv_.notify_all();
 }
 
 std::list<std::string> MediaSource::getFileDetails() const
@@ -377,22 +575,50 @@ std::list<std::string> MediaSource::getFileDetails() const
     ss.str("");
     ss.clear();
 
+    if(isProxy_)
+        details.push_back("Preview: proxy");
+
     return details;
 }
 
-void MediaSource::preloader()
+void MediaSource::preload()
 {
-    int result;
+    // runs on a MediaWorkerPool thread or the preloader of an export, never concurrently for the same source
+    if(codecsFailed_)
+        return;
 
-    while(runPreloaderThread_)
+    if(!codecsOpened_)
     {
-        std::this_thread::sleep_for(std::chrono::milliseconds(10));
-
-        if(!runPreloaderThread_)
+        if(!openCodecs())
+        {
+            codecsFailed_ = true;
+            notifyData();
             return;
+        }
+
+        codecsOpened_ = true;
+    }
+
+    if(trickPlay_ != trickPlayActive_)
+    {
+        trickPlayActive_ = trickPlay_;
+
+        LOG_IF(debug_, INFO) << "Trick play: " << (trickPlayActive_ ? "on" : "off");
+
+        pVideoCodecContext_->skip_frame = trickPlayActive_ ? AVDISCARD_NONKEY : AVDISCARD_DEFAULT;
+        pAudioStream_->discard = trickPlayActive_ ? AVDISCARD_ALL : AVDISCARD_DEFAULT;
+
+        // cached packets lack audio after trick play
+        packetCache_.clear();
 
-        updateCache(lastRequestTime_s_);
+        // cached frames do not match the new mode, start over
+        forceSeek_ = true;
     }
+
+    updateCache(lastRequestTime_s_);
+
+    // covers the end of the file and the last audio of a frame
+    notifyData();
 }
 
 MediaCachedDuration MediaSource::getCachedDuration() const
@@ -400,96 +626,436 @@ MediaCachedDuration MediaSource::getCachedDuration() const
     MediaCachedDuration cache { 0 };
     double requestTime_s = lastRequestTime_s_;
 
-    if(!videoSamples_.empty())
     {
-        cache.video_s[0] = std::max(0.0, requestTime_s - videoPtsToSeconds(videoSamples_.begin()->first));
-        cache.video_s[1] = std::max(0.0, videoPtsToSeconds(videoSamples_.rbegin()->first) - requestTime_s);
+        std::lock_guard<std::mutex> lock(videoSamplesMutex_);
+
+        if(!videoSamples_.empty())
+        {
+            cache.video_s[0] = std::max(0.0, requestTime_s - videoPtsToSeconds(videoSamples_.begin()->first));
+            cache.video_s[1] = std::max(0.0, videoPtsToSeconds(videoSamples_.rbegin()->first) - requestTime_s);
+        }
     }
 
-    if(!audioSamples_.empty())
     {
-        cache.audio_s[0] = std::max(0.0, requestTime_s - audioPtsToSeconds(audioSamples_.begin()->first));
-        cache.audio_s[1] = std::max(0.0, audioPtsToSeconds(audioSamples_.rbegin()->first) - requestTime_s);
+        std::lock_guard<std::mutex> lock(audioSamplesMutex_);
+
+        if(!audioBuffer_.empty())
+        {
+            cache.audio_s[0] = std::max(0.0, requestTime_s - audioPtsToSeconds(audioBuffer_.getFirstSample() * audioPtsInc_));
+            cache.audio_s[1] = std::max(0.0, audioPtsToSeconds(audioBuffer_.getEndSample() * audioPtsInc_) - requestTime_s);
+        }
     }
 
     return cache;
 }
 
-void MediaSource::updateCache(double requestTime_s)
+size_t MediaSource::getCachedBytes() const
 {
-    int result;
-    AVPacketWrapper pPacket;
+    std::lock_guard<std::mutex> lock(videoSamplesMutex_);
 
-    std::shared_ptr<std::map<int64_t, std::vector<uint8_t>>> audioData = nullptr;
-    std::shared_ptr<AVFrameWrapper> videoData = nullptr;
+    return videoSamplesBytes_;
+}
+
+MediaSource::CacheWindow MediaSource::getCacheWindow() const
+{
+    // Look ahead in playback direction, scaled by playback speed
+    const double lookAhead_s = 1.0;
+    const double speed = playbackSpeed_;
 
-    const double bufferTime_s = 0.5;
+    CacheWindow window { 0.25, 0.5 };
+
+    if(speed > 0.1)
+    {
+        window.ahead_s = std::max(window.ahead_s, speed * lookAhead_s);
+    }
+    else if(speed < -0.1)
+    {
+        window.behind_s = std::max(0.5, -speed * lookAhead_s);
+        window.ahead_s = 0.25;
+    }
+
+    // Limit window to a fair share of the global budget
+    const size_t frameBytes = videoFrameBytes_;
+    if(frameBytes > 0)
+    {
+        const FrameCacheManager& cacheManager = FrameCacheManager::getInstance();
+        const size_t numSources = std::max<size_t>(1, cacheManager.getNumActiveSources());
+
+        const double maxFrames = (double)cacheManager.getBudget() / (double)(frameBytes * numSources);
+        const double maxTime_s = std::max(2.0, maxFrames) * videoFrameDeltaTime_s_;
+
+        const double windowTime_s = window.behind_s + window.ahead_s;
+        if(windowTime_s > maxTime_s)
+        {
+            window.behind_s *= maxTime_s / windowTime_s;
+            window.ahead_s *= maxTime_s / windowTime_s;
+        }
+    }
+
+    // audio is kept from twice the window behind the request up to the window ahead, all of it must fit into the ring buffer
+    const double audioTime_s = 2.0 * window.behind_s + window.ahead_s;
+    const double maxAudioTime_s = AUDIO_BUFFER_DURATION_S - 1.0;
+    if(audioTime_s > maxAudioTime_s)
+    {
+        window.behind_s *= maxAudioTime_s / audioTime_s;
+        window.ahead_s *= maxAudioTime_s / audioTime_s;
+    }
+
+    return window;
+}
+
+void MediaSource::updateCache(double requestTime_s)
+{
+    const CacheWindow window = getCacheWindow();
 
     const bool invalidRequestTime = requestTime_s < 0.0 || requestTime_s >= videoPtsToSeconds(pVideoStream_->duration);
     if(invalidRequestTime)
         return;
 
+    // while scrubbing previews only decode the keyframe in front of the request, the exact frame follows once settled
+    const bool scrubbing = usage_ == Usage::PREVIEW && !trickPlayActive_ && isScrubbing();
+    if(scrubbing && scrubTime_s_ == requestTime_s)
+        return;
+
+    if(!scrubbing)
+        scrubTime_s_ = -1.0;
+
+    // with a known schedule the cache does not reach beyond the current range, the next range is prefetched instead
+    double tFillEnd_s = requestTime_s + window.ahead_s;
+
+    if(updateSchedule(requestTime_s, window, tFillEnd_s))
+        return;
+
     double cachedTimesVideo_s[2] = { 0.0, 0.0 };
     double cachedTimesAudio_s[2] = { 0.0, 0.0 };
 
-    if(!videoSamples_.empty())
     {
-        cachedTimesVideo_s[0] = videoPtsToSeconds(videoSamples_.begin()->first);
-        cachedTimesVideo_s[1] = videoPtsToSeconds(videoSamples_.rbegin()->first);
+        std::lock_guard<std::mutex> videoLock(videoSamplesMutex_);
+
+        if(!videoSamples_.empty())
+        {
+            cachedTimesVideo_s[0] = videoPtsToSeconds(videoSamples_.begin()->first);
+            cachedTimesVideo_s[1] = videoPtsToSeconds(videoSamples_.rbegin()->first);
+        }
     }
 
-    if(!audioSamples_.empty())
     {
-        cachedTimesAudio_s[0] = audioPtsToSeconds(audioSamples_.begin()->first);
-        cachedTimesAudio_s[1] = audioPtsToSeconds(audioSamples_.rbegin()->first);
+        std::lock_guard<std::mutex> audioLock(audioSamplesMutex_);
+
+        if(!audioBuffer_.empty())
+        {
+            cachedTimesAudio_s[0] = audioPtsToSeconds(audioBuffer_.getFirstSample() * audioPtsInc_);
+            cachedTimesAudio_s[1] = audioPtsToSeconds(audioBuffer_.getEndSample() * audioPtsInc_);
+        }
     }
 
-    const bool requestOutsideVideoCache = requestTime_s < cachedTimesVideo_s[0] || (requestTime_s > cachedTimesVideo_s[1] + videoFrameDeltaTime_s_ * 5);
-    const bool requestOutsideAudioCache = requestTime_s < cachedTimesAudio_s[0] || (requestTime_s > cachedTimesAudio_s[1] + videoFrameDeltaTime_s_ * 5);
+    // keyframes are sparse in trick play, allow larger gaps before seeking
+    const double seekTolerance_s = trickPlayActive_ ? std::max(2.0, window.ahead_s) : videoFrameDeltaTime_s_ * 5;
+
+    const bool requestOutsideVideoCache = requestTime_s < cachedTimesVideo_s[0] || (requestTime_s > cachedTimesVideo_s[1] + seekTolerance_s);
+    const bool requestOutsideAudioCache = !trickPlayActive_ && (requestTime_s < cachedTimesAudio_s[0] || (requestTime_s > cachedTimesAudio_s[1] + seekTolerance_s));
 
-    if(requestOutsideVideoCache || requestOutsideAudioCache)
+    if(requestOutsideVideoCache || requestOutsideAudioCache || forceSeek_)
     {
         // Seeking required
         LOG_IF(debug_, INFO) << "Seeking to: " << requestTime_s;
 
-        reachedEndOfFile_ = false;
+        forceSeek_ = false;
 
-        {
-            std::lock_guard<std::mutex> videoLock(videoSamplesMutex_);
-            videoSamples_.clear();
-        }
+        reachedEndOfFile_ = false;
 
-        {
-            std::lock_guard<std::mutex> audioLock(audioSamplesMutex_);
-            audioSamples_.clear();
-        }
+        clearCache();
 
         while(processVideoFrame(0));
         while(processAudioFrame(0));
 
-        double seekTime_s = std::max(0.0, requestTime_s - bufferTime_s*0.5);
+        if(scrubbing)
+        {
+            preRollEndPts_ = AV_NOPTS_VALUE;
+
+            packetCache_.seek(pVideoStream_->index, videoSecondsToPts(requestTime_s));
+
+            fillKeyframe();
+
+            scrubTime_s_ = requestTime_s;
+            return;
+        }
+
+        double seekTime_s = std::max(0.0, requestTime_s - window.behind_s);
 
         LOG_IF(debug_, INFO) << "Seek time: " << seekTime_s;
 
-        av_seek_frame(pFormatContext_, pVideoStream_->index, videoSecondsToPts(seekTime_s), AVSEEK_FLAG_BACKWARD);
+        // frames between the keyframe and the seek time are only decoded as references
+        preRollEndPts_ = videoSecondsToPts(seekTime_s - videoFrameDeltaTime_s_);
+
+        packetCache_.seek(pVideoStream_->index, videoSecondsToPts(seekTime_s));
 
-        fillCache(requestTime_s, requestTime_s + bufferTime_s);
+        fillCache(requestTime_s, tFillEnd_s);
+
+        if(isRequestStale(requestTime_s, tFillEnd_s))
+            return;
 
-        if(videoSamples_.empty() || audioSamples_.empty())
+        if(videoSamples_.empty() || (audioBuffer_.empty() && !trickPlayActive_))
         {
             LOG_IF(debug_, INFO) << "Missing data, seeking via audio stream.";
 
-            av_seek_frame(pFormatContext_, pAudioStream_->index, audioSecondsToPts(seekTime_s), AVSEEK_FLAG_BACKWARD);
+            preRollEndPts_ = videoSecondsToPts(seekTime_s - videoFrameDeltaTime_s_);
 
-            fillCache(requestTime_s, requestTime_s + bufferTime_s);
+            packetCache_.seek(pAudioStream_->index, audioSecondsToPts(seekTime_s));
+
+            fillCache(requestTime_s, tFillEnd_s);
         }
     }
     else
     {
         // values are in cache
-        fillCache(requestTime_s, requestTime_s + bufferTime_s);
-        cleanCache(std::max(0.0, requestTime_s - bufferTime_s));
+        fillCache(requestTime_s, tFillEnd_s);
+        cleanCache(std::max(0.0, requestTime_s - 2.0*window.behind_s));
+    }
+}
+
+void MediaSource::setSchedule(const std::vector<TimeRange>& schedule)
+{
+    std::lock_guard<std::mutex> lock(scheduleMutex_);
+
+    schedule_ = schedule;
+}
+
+bool MediaSource::updateSchedule(double requestTime_s, const CacheWindow& window, double& tFillEnd_s)
+{
+    std::vector<TimeRange> schedule;
+
+    {
+        std::lock_guard<std::mutex> lock(scheduleMutex_);
+        schedule = schedule_;
+    }
+
+    const auto current = std::find_if(schedule.begin(), schedule.end(), [&](const TimeRange& r) { return requestTime_s < r.tEnd_s; });
+    if(current == schedule.end() || current + 1 == schedule.end())
+        return false;
+
+    const TimeRange& next = *(current + 1);
+
+    if(prefetchStart_s_ >= 0.0)
+    {
+        if(requestTime_s < prefetchStart_s_ - videoFrameDeltaTime_s_)
+        {
+            // still in the current range, do not decode past its end
+            tFillEnd_s = std::min(tFillEnd_s, current->tEnd_s);
+            return false;
+        }
+
+        // arrived at the prefetched range, its audio replaces the old one
+        {
+            std::lock_guard<std::mutex> audioLock(audioSamplesMutex_);
+
+            audioBuffer_.clear();
+
+            for(const auto& pAudio : prefetchAudio_)
+                storeAudioFrame(pAudio);
+        }
+
+        prefetchAudio_.clear();
+        prefetchStart_s_ = -1.0;
+
+        return false;
+    }
+
+    // ranges close to each other are simply decoded through
+    const bool prefetchUseful = next.tStart_s > current->tEnd_s + videoFrameDeltaTime_s_ * 5 && next.tStart_s < getDuration_s();
+    if(!prefetchUseful)
+        return false;
+
+    tFillEnd_s = std::min(tFillEnd_s, current->tEnd_s);
+
+    double tVideoCacheLast_s = -1.0;
+    double tAudioCacheLast_s = -1.0;
+
+    {
+        std::lock_guard<std::mutex> videoLock(videoSamplesMutex_);
+
+        if(!videoSamples_.empty())
+            tVideoCacheLast_s = videoPtsToSeconds(videoSamples_.rbegin()->first);
     }
+
+    {
+        std::lock_guard<std::mutex> audioLock(audioSamplesMutex_);
+
+        if(!audioBuffer_.empty())
+            tAudioCacheLast_s = audioPtsToSeconds(audioBuffer_.getEndSample() * audioPtsInc_);
+    }
+
+    // prefetch once the current range is completely decoded
+    const bool currentComplete = requestTime_s >= current->tStart_s && tVideoCacheLast_s >= current->tEnd_s - videoFrameDeltaTime_s_ &&
+                                 (tAudioCacheLast_s >= current->tEnd_s - videoFrameDeltaTime_s_ || trickPlayActive_);
+    if(!currentComplete)
+        return false;
+
+    prefetchRange(next.tStart_s, next.tStart_s + window.ahead_s);
+
+    return true;
+}
+
+void MediaSource::prefetchRange(double tStart_s, double tEnd_s)
+{
+    int result;
+    AVPacketWrapper pPacket;
+
+    LOG_IF(debug_, INFO) << "Prefetching: " << tStart_s << " - " << tEnd_s;
+
+    while(processVideoFrame(0));
+    while(processAudioFrame(0));
+
+    reachedEndOfFile_ = false;
+    prefetchStart_s_ = tStart_s;
+    prefetchAudio_.clear();
+
+    preRollEndPts_ = videoSecondsToPts(tStart_s - videoFrameDeltaTime_s_);
+
+    packetCache_.seek(pVideoStream_->index, videoSecondsToPts(tStart_s));
+
+    double tVideoLast_s = 0.0;
+    double tAudioLast_s = trickPlayActive_ ? tEnd_s : 0.0;
+
+    // video goes directly into the cache, audio is held back until the range is reached
+    while((tVideoLast_s < tEnd_s || tAudioLast_s < tEnd_s) && !reachedEndOfFile_)
+    {
+        av_packet_unref(pPacket);
+
+        std::shared_ptr<AVFrameWrapper> videoData;
+        std::shared_ptr<AVFrameWrapper> audioData;
+
+        result = packetCache_.read(pPacket);
+        if(result == AVERROR_EOF)
+        {
+            videoData = processVideoFrame(0);
+            audioData = trickPlayActive_ ? nullptr : processAudioFrame(0);
+            reachedEndOfFile_ = true;
+        }
+        else if(result < 0)
+        {
+            return;
+        }
+        else if(pPacket->stream_index == pVideoStream_->index)
+        {
+            videoData = processVideoFrame(pPacket);
+        }
+        else if(pPacket->stream_index == pAudioStream_->index && !trickPlayActive_)
+        {
+            audioData = processAudioFrame(pPacket);
+        }
+
+        if(videoData)
+        {
+            tVideoLast_s = videoPtsToSeconds((*videoData)->pts);
+
+            if(tVideoLast_s >= tStart_s - videoFrameDeltaTime_s_ && !cacheVideoFrame(videoData, false))
+            {
+                LOG_IF(debug_, INFO) << "Frame cache budget exhausted during prefetch at " << tVideoLast_s;
+
+                std::lock_guard<std::mutex> videoLock(videoSamplesMutex_);
+                pPendingVideoFrame_ = videoData;
+                return;
+            }
+        }
+
+        if(audioData)
+        {
+            const AVFrame* pAudio = *audioData;
+
+            tAudioLast_s = audioPtsToSeconds(pAudio->pts + pAudio->nb_samples * audioPtsInc_);
+
+            if(tAudioLast_s >= tStart_s)
+                prefetchAudio_.push_back(audioData);
+        }
+    }
+}
+
+void MediaSource::storeAudioFrame(std::shared_ptr<AVFrameWrapper> pFrame)
+{
+    // audioSamplesMutex_ must be held by caller
+    const AVFrame* pAudio = *pFrame;
+
+    if(!audioBuffer_.isSetup())
+    {
+        uint64_t channelLayout = pAudio->channel_layout;
+        if(channelLayout == 0)
+            channelLayout = av_get_default_channel_layout(pAudio->channels);
+
+        audioBuffer_.setup((enum AVSampleFormat)pAudio->format, pAudio->channels, channelLayout, pAudio->sample_rate, pAudio->sample_rate * AUDIO_BUFFER_DURATION_S);
+    }
+
+    audioBuffer_.write(pAudio, pAudio->pts / audioPtsInc_);
+}
+
+bool MediaSource::isScrubbing() const
+{
+    const auto tLastJump = std::chrono::steady_clock::time_point(std::chrono::steady_clock::duration(lastJumpTime_));
+
+    return std::chrono::steady_clock::now() - tLastJump < SCRUB_SETTLE_TIME;
+}
+
+bool MediaSource::isRequestStale(double tFirst_s, double tLast_s) const
+{
+    const double requestTime_s = lastRequestTime_s_;
+
+    return requestTime_s < tFirst_s - videoFrameDeltaTime_s_ * 5 || requestTime_s > tLast_s;
+}
+
+void MediaSource::fillKeyframe()
+{
+    int result;
+    AVPacketWrapper pPacket;
+
+    // decode until the first video frame after a seek, audio is ignored
+    while(1)
+    {
+        av_packet_unref(pPacket);
+
+        result = packetCache_.read(pPacket);
+        if(result < 0)
+        {
+            auto videoData = processVideoFrame(0);
+            if(videoData)
+                cacheVideoFrame(videoData, true);
+
+            return;
+        }
+
+        if(pPacket->stream_index != pVideoStream_->index)
+            continue;
+
+        auto videoData = processVideoFrame(pPacket);
+        if(videoData)
+        {
+            cacheVideoFrame(videoData, true);
+            return;
+        }
+    }
+}
+
+void MediaSource::clearCache()
+{
+    size_t releasedBytes = 0;
+
+    {
+        std::lock_guard<std::mutex> videoLock(videoSamplesMutex_);
+        videoSamples_.clear();
+        pPendingVideoFrame_.reset();
+
+        releasedBytes = videoSamplesBytes_;
+        videoSamplesBytes_ = 0;
+    }
+
+    FrameCacheManager::getInstance().release(this, releasedBytes);
+
+    {
+        std::lock_guard<std::mutex> audioLock(audioSamplesMutex_);
+        audioBuffer_.clear();
+    }
+
+    prefetchAudio_.clear();
+    prefetchStart_s_ = -1.0;
 }
 
 void MediaSource::fillCache(double tFirst_s, double tLast_s)
@@ -503,23 +1069,55 @@ void MediaSource::fillCache(double tFirst_s, double tLast_s)
     double tVideoCacheLast_s = 0.0;
     double tAudioCacheLast_s = 0.0;
 
-    if(!videoSamples_.empty())
-        tVideoCacheLast_s = videoPtsToSeconds(videoSamples_.rbegin()->first);
+    {
+        std::lock_guard<std::mutex> videoLock(videoSamplesMutex_);
 
-    if(!audioSamples_.empty())
-        tAudioCacheLast_s = audioPtsToSeconds(audioSamples_.rbegin()->first);
+        if(!videoSamples_.empty())
+            tVideoCacheLast_s = videoPtsToSeconds(videoSamples_.rbegin()->first);
+
+        videoData = pPendingVideoFrame_;
+        pPendingVideoFrame_.reset();
+    }
+
+    {
+        std::lock_guard<std::mutex> audioLock(audioSamplesMutex_);
+
+        if(!audioBuffer_.empty())
+            tAudioCacheLast_s = audioPtsToSeconds(audioBuffer_.getEndSample() * audioPtsInc_);
+    }
+
+    // audio is not decoded during trick play
+    if(trickPlayActive_)
+        tAudioCacheLast_s = tLast_s;
+
+    // a frame which did not fit into the budget last time goes first
+    if(videoData)
+    {
+        if(!cacheVideoFrame(videoData, false))
+            return;
+
+        tVideoCacheLast_s = videoPtsToSeconds((*videoData)->pts);
+        videoData = nullptr;
+    }
 
     while((tVideoCacheLast_s < tLast_s || tAudioCacheLast_s < tLast_s) && !reachedEndOfFile_)
     {
+        if(isRequestStale(tFirst_s, tLast_s))
+        {
+            LOG_IF(debug_, INFO) << "Request moved to " << lastRequestTime_s_ << ", cancelling cache fill.";
+
+            return;
+        }
+
         av_packet_unref(pPacket);
 
-        result = av_read_frame(pFormatContext_, pPacket);
+        result = packetCache_.read(pPacket);
         if(result == AVERROR_EOF)
         {
             LOG_IF(debug_, INFO) << "EOF. Flushing codecs.";
 
             videoData = processVideoFrame(0);
-            audioData = processAudioFrame(0);
+            audioData = trickPlayActive_ ? nullptr : processAudioFrame(0);
             reachedEndOfFile_ = true;
         }
         else if(result < 0)
@@ -535,7 +1133,7 @@ void MediaSource::fillCache(double tFirst_s, double tLast_s)
                 videoData = processVideoFrame(pPacket);
             }
 
-            if(pPacket->stream_index == pAudioStream_->index)
+            if(pPacket->stream_index == pAudioStream_->index && !trickPlayActive_)
             {
                 audioData = processAudioFrame(pPacket);
             }
@@ -545,66 +1143,139 @@ void MediaSource::fillCache(double tFirst_s, double tLast_s)
         {
             const double tVideo_s = videoPtsToSeconds((*videoData)->pts);
 
-            if(videoSamples_.empty() && tVideo_s > tFirst_s)
+            bool videoCacheEmpty;
+
+            {
+                std::lock_guard<std::mutex> videoLock(videoSamplesMutex_);
+                videoCacheEmpty = videoSamples_.empty();
+            }
+
+            if(videoCacheEmpty && tVideo_s > tFirst_s)
             {
                 LOG_IF(debug_, INFO) << "First video sample (" << tVideo_s << ") after required time (" << tFirst_s << ")";
 
                 return;
             }
 
+            // frames up to the requested time are always required, frames ahead only within budget
+            if(!cacheVideoFrame(videoData, tVideo_s <= tFirst_s + videoFrameDeltaTime_s_))
             {
+                LOG_IF(debug_, INFO) << "Frame cache budget exhausted at " << tVideo_s;
+
                 std::lock_guard<std::mutex> videoLock(videoSamplesMutex_);
-                videoSamples_[(*videoData)->pts] = videoData;
+                pPendingVideoFrame_ = videoData;
+                return;
             }
 
-            tVideoCacheLast_s = videoPtsToSeconds(videoSamples_.rbegin()->first);
+            tVideoCacheLast_s = tVideo_s;
         }
 
         if(audioData)
         {
             const double tFirstAudio_s = audioPtsToSeconds((*audioData)->pts);
 
-            if(audioSamples_.empty() && tFirstAudio_s > tFirst_s)
+            std::lock_guard<std::mutex> audioLock(audioSamplesMutex_);
+
+            if(audioBuffer_.empty() && tFirstAudio_s > tFirst_s)
             {
                 LOG_IF(debug_, INFO) << "First audio sample (" << tFirstAudio_s << ") after required time (" << tFirst_s << ")";
 
                 return;
             }
 
-            {
-                std::lock_guard<std::mutex> audioLock(audioSamplesMutex_);
-                audioSamples_[(*audioData)->pts] = audioData;
-            }
+            // decoded audio is converted once into the planar ring buffer
+            storeAudioFrame(audioData);
 
-            tAudioCacheLast_s = audioPtsToSeconds(audioSamples_.rbegin()->first);
+            tAudioCacheLast_s = audioPtsToSeconds(audioBuffer_.getEndSample() * audioPtsInc_);
         }
     }
 }
 
+bool MediaSource::cacheVideoFrame(std::shared_ptr<AVFrameWrapper> pFrame, bool force)
+{
+    const size_t frameBytes = FrameCacheManager::getFrameSize(*pFrame);
+    videoFrameBytes_ = frameBytes;
+
+    if(!FrameCacheManager::getInstance().reserve(this, frameBytes, force))
+        return false;
+
+    size_t replacedBytes = 0;
+
+    {
+        std::lock_guard<std::mutex> videoLock(videoSamplesMutex_);
+
+        auto& pSample = videoSamples_[(*pFrame)->pts];
+        if(pSample)
+            replacedBytes = FrameCacheManager::getFrameSize(*pSample);
+
+        pSample = pFrame;
+
+        videoSamplesBytes_ += frameBytes;
+        videoSamplesBytes_ -= replacedBytes;
+    }
+
+    if(replacedBytes)
+        FrameCacheManager::getInstance().release(this, replacedBytes);
+
+    notifyData();
+
+    return true;
+}
+
 void MediaSource::cleanCache(double tOld_s)
 {
     const int64_t tVideoPtsOld = videoSecondsToPts(tOld_s);
     const int64_t tAudioPtsOld = audioSecondsToPts(tOld_s);
 
+    size_t releasedBytes = 0;
+
     {
         std::lock_guard<std::mutex> videoLock(videoSamplesMutex_);
         const auto& iterVideoMinLimit = videoSamples_.lower_bound(tVideoPtsOld);
         if(iterVideoMinLimit != videoSamples_.end())
+        {
+            for(auto iter = videoSamples_.begin(); iter != iterVideoMinLimit; iter++)
+                releasedBytes += FrameCacheManager::getFrameSize(*iter->second);
+
             videoSamples_.erase(videoSamples_.begin(), iterVideoMinLimit);
+            videoSamplesBytes_ -= std::min(releasedBytes, videoSamplesBytes_);
+        }
     }
 
+    if(releasedBytes)
+        FrameCacheManager::getInstance().release(this, releasedBytes);
+
     {
         std::lock_guard<std::mutex> audioLock(audioSamplesMutex_);
-        const auto& iterAudioMinLimit = audioSamples_.lower_bound(tAudioPtsOld);
-        if(iterAudioMinLimit != audioSamples_.end())
-            audioSamples_.erase(audioSamples_.begin(), iterAudioMinLimit);
+        audioBuffer_.discardBefore(tAudioPtsOld / audioPtsInc_);
     }
 }
 
+size_t MediaSource::evictCache()
+{
+    // called by FrameCacheManager, must not call back into it
+    std::lock_guard<std::mutex> videoLock(videoSamplesMutex_);
+
+    const size_t releasedBytes = videoSamplesBytes_;
+
+    videoSamples_.clear();
+    videoSamplesBytes_ = 0;
+
+    return releasedBytes;
+}
+
 std::shared_ptr<AVFrameWrapper> MediaSource::processVideoFrame(AVPacket* pPacket)
 {
     int result;
 
+    // non-reference frames in the pre-roll are not needed by anyone, let the decoder drop them
+    if(pPacket && !trickPlayActive_)
+    {
+        const bool preRoll = preRollEndPts_ != AV_NOPTS_VALUE && pPacket->pts != AV_NOPTS_VALUE && pPacket->pts < preRollEndPts_;
+
+        pVideoCodecContext_->skip_frame = preRoll ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
+    }
+
     result = avcodec_send_packet(pVideoCodecContext_, pPacket);
     if(result < 0)
     {
@@ -620,6 +1291,19 @@ std::shared_ptr<AVFrameWrapper> MediaSource::processVideoFrame(AVPacket* pPacket
     result = avcodec_receive_frame(pVideoCodecContext_, *pWrapperRx);
     if(result >= 0)
     {
+        // pre-roll frames are never shown, skip transfer and conversion
+        if(pPacket && preRollEndPts_ != AV_NOPTS_VALUE)
+        {
+            if((*pWrapperRx)->pts < preRollEndPts_)
+            {
+                LOG_IF(debug_, INFO) << "Pre-roll frame: " << pVideoCodecContext_->frame_number << ", PTS: " << (*pWrapperRx)->pts;
+
+                return nullptr;
+            }
+
+            preRollEndPts_ = AV_NOPTS_VALUE;
+        }
+
         if((*pWrapperRx)->format == hwPixFormat_)
         {
             result = av_hwframe_transfer_data(*pWrapper, *pWrapperRx, 0); // transfer from GPU to CPU
@@ -651,6 +1335,9 @@ std::shared_ptr<AVFrameWrapper> MediaSource::processVideoFrame(AVPacket* pPacket
             }
         }
 
+        if(usage_ == Usage::PREVIEW)
+            return scalePreviewFrame(pWrapper);
+
         return pWrapper;
     }
     else if(result == AVERROR(EAGAIN))
@@ -666,6 +1353,47 @@ std::shared_ptr<AVFrameWrapper> MediaSource::processVideoFrame(AVPacket* pPacket
     }
 }
 
+std::shared_ptr<AVFrameWrapper> MediaSource::scalePreviewFrame(std::shared_ptr<AVFrameWrapper> pWrapper)
+{
+    int result;
+
+    const AVFrame* pFrame = *pWrapper;
+
+    if(pFrame->height <= PREVIEW_HEIGHT && pFrame->format == AV_PIX_FMT_YUV420P)
+        return pWrapper;
+
+    const int height = std::min(PREVIEW_HEIGHT, pFrame->height);
+    const int width = ((pFrame->width * height / pFrame->height) + 1) & ~1;
+
+    pPreviewScaler_ = sws_getCachedContext(pPreviewScaler_, pFrame->width, pFrame->height, (enum AVPixelFormat)pFrame->format,
+                          width, height, AV_PIX_FMT_YUV420P, SWS_FAST_BILINEAR, NULL, NULL, NULL);
+    if(!pPreviewScaler_)
+    {
+        LOG(ERROR) << "Could not create preview scaler.";
+        return pWrapper;
+    }
+
+    auto pScaled = std::make_shared<AVFrameWrapper>();
+    AVFrame* pScaledFrame = *pScaled;
+
+    pScaledFrame->format = AV_PIX_FMT_YUV420P;
+    pScaledFrame->width = width;
+    pScaledFrame->height = height;
+
+    result = av_frame_get_buffer(pScaledFrame, 0);
+    if(result < 0)
+    {
+        LOG(ERROR) << "Not enough memory for preview frame.";
+        return pWrapper;
+    }
+
+    av_frame_copy_props(pScaledFrame, pFrame);
+
+    sws_scale(pPreviewScaler_, pFrame->data, pFrame->linesize, 0, pFrame->height, pScaledFrame->data, pScaledFrame->linesize);
+
+    return pScaled;
+}
+
 std::shared_ptr<AVFrameWrapper> MediaSource::processAudioFrame(AVPacket* pPacket)
 {
     int result;
@@ -1,8 +1,16 @@
 #pragma once
 
 #include "MediaFrame.hpp"
+#include "AudioRingBuffer.hpp"
+#include "PacketCache.hpp"
+#include "FileReader.hpp"
+
+extern "C" {
+#include <libswscale/swscale.h>
+}
 
 #include <string>
+#include <chrono>
 #include <thread>
 #include <atomic>
 #include <mutex>
@@ -17,13 +25,34 @@ struct MediaCachedDuration
     double video_s[2];
 };
 
+struct TimeRange
+{
+    double tStart_s;
+    double tEnd_s;
+};
+
 class MediaSource
 {
 public:
-    MediaSource(std::string filename, bool useHwDecoder = false, std::string hwDecoder = "");
+    enum class Usage
+    {
+        EXPORT,
+        PREVIEW,
+    };
+
+    MediaSource(std::string filename, bool useHwDecoder = false, std::string hwDecoder = "", Usage usage = Usage::EXPORT);
     ~MediaSource();
 
+    static std::string getProxyFilename(const std::string& filename);
+
+    static constexpr int PREVIEW_HEIGHT = 540;
+
     bool isLoaded() const { return isLoaded_; }
+
+    // codecs are opened on first use, a source failing there never delivers frames
+    bool hasFailed() const { return codecsFailed_; }
+    bool isProxy() const { return isProxy_; }
+    Usage getUsage() const { return usage_; }
     std::string getFilename() const { return filename_; }
     bool hasReachedEndOfFile() const { return reachedEndOfFile_; }
 
@@ -33,10 +62,24 @@ public:
     void seekTo(double time_s);
     void seekToNext();
     void seekToPrevious();
+
+    // ranges which will be requested in this order, used to prefetch the next range
+    void setSchedule(const std::vector<TimeRange>& schedule);
     std::shared_ptr<MediaFrame> get();
+
+    // blocks until get() delivers a frame, the file ends, decoding fails or maxWait passed
+    std::shared_ptr<MediaFrame> waitForFrame(std::chrono::milliseconds maxWait);
     double tell() const { return lastRequestTime_s_; }
 
     MediaCachedDuration getCachedDuration() const;
+    size_t getCachedBytes() const;
+    size_t getCachedPacketBytes() const { return packetCache_.getBytes(); }
+    FileReaderStats getFileStats() const;
+    double getPlaybackSpeed() const { return playbackSpeed_; }
+
+    // only decode keyframes and skip audio, for fast playback
+    void setTrickPlay(bool enable) { trickPlay_ = enable; }
+    bool isTrickPlay() const { return trickPlay_; }
 
     std::list<std::string> getFileDetails() const;
 
@@ -48,45 +91,118 @@ public:
     enum AVPixelFormat internalGetHwFormat(AVCodecContext *ctx, const enum AVPixelFormat *pix_fmts);
 
 private:
+    friend class FrameCacheManager;
+    friend class MediaWorkerPool;
+
+    struct CacheWindow
+    {
+        double behind_s;
+        double ahead_s;
+    };
+
     std::string err2str(int errnum);
 
+    bool openCodecs();
+    void activate();
+    void deactivate();
     void preloader();
+    std::chrono::steady_clock::duration getIdleTime() const;
+
+    void preload();
+    void notifyData();
+    void updatePlaybackSpeed(double time_s);
+    CacheWindow getCacheWindow() const;
     void updateCache(double requestTime_s);
     void fillCache(double tFirst_s, double tLast_s);
+    void fillKeyframe();
+    bool updateSchedule(double requestTime_s, const CacheWindow& window, double& tFillEnd_s);
+    void prefetchRange(double tStart_s, double tEnd_s);
+    void storeAudioFrame(std::shared_ptr<AVFrameWrapper> pFrame);
+    void clearCache();
+    bool isScrubbing() const;
+    bool isRequestStale(double tFirst_s, double tLast_s) const;
+    bool cacheVideoFrame(std::shared_ptr<AVFrameWrapper> pFrame, bool force);
     void cleanCache(double tOld_s);
+    size_t evictCache();
 
     std::shared_ptr<AVFrameWrapper> processVideoFrame(AVPacket* pPacket);
+    std::shared_ptr<AVFrameWrapper> scalePreviewFrame(std::shared_ptr<AVFrameWrapper> pWrapper);
     std::shared_ptr<AVFrameWrapper> processAudioFrame(AVPacket* pPacket);
 
     bool debug_;
     bool isLoaded_;
     std::string filename_;
+    Usage usage_;
+    bool isProxy_;
 
+    std::unique_ptr<FileReader> pFileReader_;
     AVFormatContext* pFormatContext_;
 
     AVCodec* pVideoCodec_;
     AVStream* pVideoStream_;
     AVCodecContext* pVideoCodecContext_;
+    const AVCodecHWConfig* pVideoHWConfig_;
     enum AVPixelFormat hwPixFormat_;
     AVBufferRef *pHwDeviceContext_;
+    struct SwsContext* pPreviewScaler_;
 
     AVCodec* pAudioCodec_;
     AVStream* pAudioStream_;
     AVCodecContext* pAudioCodecContext_;
 
     std::atomic<double> lastRequestTime_s_;
+    std::atomic<std::chrono::steady_clock::rep> lastAccessTime_;
     bool reachedEndOfFile_;
 
-    std::mutex videoSamplesMutex_;
+    mutable std::mutex videoSamplesMutex_;
     std::map<int64_t, std::shared_ptr<AVFrameWrapper>> videoSamples_;
+    size_t videoSamplesBytes_;
+    std::atomic<size_t> videoFrameBytes_;
+    std::shared_ptr<AVFrameWrapper> pPendingVideoFrame_;
+
+    mutable std::mutex audioSamplesMutex_;
+    AudioRingBuffer audioBuffer_;
 
-    std::mutex audioSamplesMutex_;
-    std::map<int64_t, std::shared_ptr<AVFrameWrapper>> audioSamples_;
+    static constexpr int AUDIO_BUFFER_DURATION_S = 16;
+
+    // compressed packets around the playhead, previews decode from here when jumping around
+    PacketCache packetCache_;
+
+    static constexpr size_t PACKET_CACHE_SIZE = 256ULL*1024*1024;
 
     int64_t audioPtsInc_;
     int64_t videoPtsInc_;
     double videoFrameDeltaTime_s_;
 
+    std::atomic<double> playbackSpeed_;
+    double speedSampleTime_s_;
+    std::chrono::steady_clock::time_point speedSampleWallTime_;
+
+    std::atomic<bool> trickPlay_;
+    bool trickPlayActive_;
+    bool forceSeek_;
+    int64_t preRollEndPts_;
+
+    std::atomic<std::chrono::steady_clock::rep> lastJumpTime_;
+    double scrubTime_s_;
+
+    static constexpr std::chrono::milliseconds SCRUB_SETTLE_TIME { 150 };
+
+    std::mutex scheduleMutex_;
+    std::vector<TimeRange> schedule_;
+    double prefetchStart_s_;
+    std::vector<std::shared_ptr<AVFrameWrapper>> prefetchAudio_;
+
+    std::atomic<bool> isScheduled_;
+    std::atomic<bool> codecsOpened_;
+    std::atomic<bool> codecsFailed_;
+
+    // signalled whenever decoded data arrives
+    std::mutex dataMutex_;
+    std::condition_variable dataCv_;
+    uint64_t dataVersion_;
+
+    // exports decode on their own thread, the worker pool only serves previews
     std::thread preloaderThread_;
     std::atomic<bool> runPreloaderThread_;
 };
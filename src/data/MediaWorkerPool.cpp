@@ -0,0 +1,145 @@
+#include "MediaWorkerPool.hpp"
+#include "MediaSource.hpp"
+#include "util/easylogging++.h"
+#include <algorithm>
+
+MediaWorkerPool& MediaWorkerPool::getInstance()
+{
+    static MediaWorkerPool instance;
+    return instance;
+}
+
+MediaWorkerPool::MediaWorkerPool()
+:runWorkers_(true)
+{
+    const unsigned int numThreads = std::clamp(std::thread::hardware_concurrency()/2, 2U, 8U);
+
+    LOG(INFO) << "Starting " << numThreads << " media worker threads.";
+
+    for(unsigned int i = 0; i < numThreads; i++)
+        workers_.emplace_back(&MediaWorkerPool::worker, this);
+}
+
+MediaWorkerPool::~MediaWorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        runWorkers_ = false;
+    }
+
+    cv_.notify_all();
+
+    for(auto& worker : workers_)
+    {
+        if(worker.joinable())
+            worker.join();
+    }
+}
+
+void MediaWorkerPool::activate(MediaSource* pSource)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto iter = std::find_if(sources_.begin(), sources_.end(), [&](const Entry& e) { return e.pSource == pSource; });
+    if(iter != sources_.end())
+        return;
+
+    sources_.push_back(Entry{ pSource, false, std::chrono::steady_clock::now() });
+    pSource->isScheduled_ = true;
+
+    cv_.notify_one();
+}
+
+void MediaWorkerPool::remove(MediaSource* pSource)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    auto findEntry = [&]() { return std::find_if(sources_.begin(), sources_.end(), [&](const Entry& e) { return e.pSource == pSource; }); };
+
+    // wait until no worker is using this source anymore
+    cv_.wait(lock, [&]() { auto iter = findEntry(); return iter == sources_.end() || !iter->busy; });
+
+    auto iter = findEntry();
+    if(iter != sources_.end())
+        sources_.erase(iter);
+
+    pSource->isScheduled_ = false;
+}
+
+size_t MediaWorkerPool::getNumActiveSources() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    return sources_.size();
+}
+
+void MediaWorkerPool::worker()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    while(runWorkers_)
+    {
+        const auto tNow = std::chrono::steady_clock::now();
+        auto tWakeUp = tNow + UPDATE_INTERVAL;
+        auto next = sources_.end();
+
+        // pick the source waiting the longest for an update
+        for(auto iter = sources_.begin(); iter != sources_.end(); iter++)
+        {
+            if(iter->busy)
+                continue;
+
+            if(iter->nextUpdate <= tNow)
+            {
+                if(next == sources_.end() || iter->nextUpdate < next->nextUpdate)
+                    next = iter;
+            }
+            else
+            {
+                tWakeUp = std::min(tWakeUp, iter->nextUpdate);
+            }
+        }
+
+        if(next == sources_.end())
+        {
+            cv_.wait_until(lock, tWakeUp);
+            continue;
+        }
+
+        MediaSource* pSource = next->pSource;
+
+        if(pSource->getIdleTime() > IDLE_TIMEOUT)
+        {
+            LOG(INFO) << "Media source idle, stopping preloader: " << pSource->getFilename();
+
+            // buffers are released outside of the lock, the busy entry keeps the source from being removed meanwhile
+            next->busy = true;
+
+            lock.unlock();
+
+            pSource->deactivate();
+
+            lock.lock();
+
+            pSource->isScheduled_ = false;
+            sources_.erase(next);
+
+            cv_.notify_all();
+            continue;
+        }
+
+        next->busy = true;
+
+        lock.unlock();
+
+        pSource->preload();
+
+        lock.lock();
+
+        // entry cannot be removed while busy
+        next->busy = false;
+        next->nextUpdate = std::chrono::steady_clock::now() + UPDATE_INTERVAL;
+
+        cv_.notify_all();
+    }
+}
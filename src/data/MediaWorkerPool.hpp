@@ -0,0 +1,49 @@
+#pragma once
+
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <list>
+#include <vector>
+
+class MediaSource;
+
+// Small set of threads shared by all preview MediaSources to fill their caches.
+// Sources are added on first access and dropped again after some idle time.
+// Export sources use a dedicated thread each, so exports scale with the cores.
+class MediaWorkerPool
+{
+public:
+    static MediaWorkerPool& getInstance();
+
+    ~MediaWorkerPool();
+
+    void activate(MediaSource* pSource);
+    void remove(MediaSource* pSource);
+
+    size_t getNumThreads() const { return workers_.size(); }
+    size_t getNumActiveSources() const;
+
+private:
+    MediaWorkerPool();
+
+    struct Entry
+    {
+        MediaSource* pSource;
+        bool busy;
+        std::chrono::steady_clock::time_point nextUpdate;
+    };
+
+    void worker();
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    std::list<Entry> sources_;
+
+    std::vector<std::thread> workers_;
+    bool runWorkers_;
+
+    static constexpr std::chrono::milliseconds UPDATE_INTERVAL { 10 };
+    static constexpr std::chrono::seconds IDLE_TIMEOUT { 10 };
+};
@@ -0,0 +1,111 @@
+#include "PacketCache.hpp"
+
+PacketCache::PacketCache()
+:pFormatContext_(0),
+ cursor_(0),
+ reachedEndOfFile_(false),
+ bytes_(0),
+ maxBytes_(0)
+{
+}
+
+void PacketCache::setup(AVFormatContext* pFormatContext, size_t maxBytes)
+{
+    pFormatContext_ = pFormatContext;
+    maxBytes_ = maxBytes;
+
+    clear();
+}
+
+void PacketCache::clear()
+{
+    packets_.clear();
+    cursor_ = 0;
+    reachedEndOfFile_ = false;
+    bytes_ = 0;
+}
+
+int PacketCache::seek(int streamIndex, int64_t timestamp)
+{
+    // last keyframe in front of the timestamp, only valid if the cache also reaches beyond it
+    size_t keyframe = packets_.size();
+    bool coversTimestamp = false;
+
+    for(size_t i = 0; i < packets_.size(); i++)
+    {
+        const AVPacket* pPacket = *packets_[i];
+
+        if(pPacket->stream_index != streamIndex || pPacket->pts == AV_NOPTS_VALUE)
+            continue;
+
+        if(pPacket->pts <= timestamp && (pPacket->flags & AV_PKT_FLAG_KEY))
+            keyframe = i;
+
+        if(pPacket->pts >= timestamp)
+        {
+            coversTimestamp = true;
+            break;
+        }
+    }
+
+    if(keyframe < packets_.size() && coversTimestamp)
+    {
+        cursor_ = keyframe;
+        return 0;
+    }
+
+    // outside of cached part, start over at the new position
+    clear();
+
+    return av_seek_frame(pFormatContext_, streamIndex, timestamp, AVSEEK_FLAG_BACKWARD);
+}
+
+int PacketCache::read(AVPacket* pPacket)
+{
+    if(maxBytes_ == 0)
+        return av_read_frame(pFormatContext_, pPacket);
+
+    if(cursor_ < packets_.size())
+        return av_packet_ref(pPacket, *packets_[cursor_++]);
+
+    if(reachedEndOfFile_)
+        return AVERROR_EOF;
+
+    // the demuxer is always positioned right after the last cached packet
+    int result = av_read_frame(pFormatContext_, pPacket);
+    if(result == AVERROR_EOF)
+        reachedEndOfFile_ = true;
+
+    if(result < 0)
+        return result;
+
+    auto pCached = std::make_shared<AVPacketWrapper>();
+
+    // cached part must stay contiguous, start over if the packet cannot be kept
+    if(av_packet_ref(*pCached, pPacket) < 0)
+    {
+        packets_.clear();
+        cursor_ = 0;
+        bytes_ = 0;
+        return 0;
+    }
+
+    packets_.push_back(pCached);
+    bytes_ += (*pCached)->size;
+    cursor_ = packets_.size();
+
+    trim();
+
+    return 0;
+}
+
+void PacketCache::trim()
+{
+    // drop oldest packets, but never what has not been read yet
+    while(bytes_ > maxBytes_ && cursor_ > 0)
+    {
+        bytes_ -= (*packets_.front())->size;
+        packets_.pop_front();
+        cursor_--;
+    }
+}
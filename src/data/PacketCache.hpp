@@ -0,0 +1,38 @@
+#pragma once
+
+#include "AVWrapper.hpp"
+
+#include <atomic>
+#include <deque>
+#include <memory>
+
+// Demuxed packets of one contiguous part of a file in demux order. Reads and
+// seeks inside the cached part are served from memory, everything else goes
+// to the demuxer. A max size of zero disables caching.
+class PacketCache
+{
+public:
+    PacketCache();
+
+    void setup(AVFormatContext* pFormatContext, size_t maxBytes);
+    void clear();
+
+    // same semantics as av_seek_frame(..., AVSEEK_FLAG_BACKWARD) and av_read_frame
+    int seek(int streamIndex, int64_t timestamp);
+    int read(AVPacket* pPacket);
+
+    size_t getBytes() const { return bytes_; }
+    size_t getMaxBytes() const { return maxBytes_; }
+
+private:
+    void trim();
+
+    AVFormatContext* pFormatContext_;
+
+    std::deque<std::shared_ptr<AVPacketWrapper>> packets_;
+    size_t cursor_;
+    bool reachedEndOfFile_;
+
+    std::atomic<size_t> bytes_;
+    size_t maxBytes_;
+};
@@ -127,9 +127,11 @@ void ImageComposer::drawVideoFrameGrey(AVFrame* pFrame, ImVec2 pos, ImVec2 size)
 
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, videoTextures_[0]);
-    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, pFrame->linesize[0]);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, pFrame->width, pFrame->height, 0, GL_RED, GL_UNSIGNED_BYTE, pFrame->data[0]);
 
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
     glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
 }
 
@@ -140,21 +142,23 @@ void ImageComposer::drawVideoFrameRGB(AVFrame* pFrame, ImVec2 pos, ImVec2 size)
 
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, videoTextures_[0]);
-    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, pFrame->linesize[0]);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, pFrame->width, pFrame->height, 0, GL_RED, GL_UNSIGNED_BYTE, pFrame->data[0]);
 
     glActiveTexture(GL_TEXTURE1);
     glBindTexture(GL_TEXTURE_2D, videoTextures_[1]);
-    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, pFrame->linesize[1]);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, pFrame->width/2, pFrame->height/2, 0, GL_RED, GL_UNSIGNED_BYTE, pFrame->data[1]);
 
     glActiveTexture(GL_TEXTURE2);
     glBindTexture(GL_TEXTURE_2D, videoTextures_[2]);
-    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, pFrame->linesize[2]);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, pFrame->width/2, pFrame->height/2, 0, GL_RED, GL_UNSIGNED_BYTE, pFrame->data[2]);
 
     // TODO: Consider using glTexSubImage2D for updates
 
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
     glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
 }
 
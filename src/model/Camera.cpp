@@ -5,14 +5,45 @@
 
 VideoRecording::VideoRecording(std::string videoFilename)
 :tStart_ns_(0),
- frontGap_ns_(0)
+ frontGap_ns_(0),
+ duration_s_(0.0),
+ frameDelta_s_(0.0)
 {
-    pVideo_ = std::make_shared<MediaSource>(videoFilename);
+    pVideo_ = std::make_shared<MediaSource>(videoFilename, false, "", MediaSource::Usage::PREVIEW);
+
+    readTiming();
 }
 
-std::string VideoRecording::getName() const
+void VideoRecording::reloadVideo()
+{
+    pVideo_ = std::make_shared<MediaSource>(pVideo_->getFilename(), false, "", MediaSource::Usage::PREVIEW);
+
+    readTiming();
+}
+
+void VideoRecording::readTiming()
 {
     if(!pVideo_->isLoaded())
+        return;
+
+    duration_s_ = pVideo_->getDuration_s();
+    frameDelta_s_ = pVideo_->getFrameDeltaTime();
+
+    if(!pVideo_->isProxy())
+        return;
+
+    // exports read the original, codecs are not opened just for this
+    MediaSource original(pVideo_->getFilename());
+    if(!original.isLoaded())
+        return;
+
+    duration_s_ = original.getDuration_s();
+    frameDelta_s_ = original.getFrameDeltaTime();
+}
+
+std::string VideoRecording::getName() const
+{
+    if(!pVideo_->isLoaded() || pVideo_->hasFailed())
         return "Load Error";
 
     return std::filesystem::path(pVideo_->getFilename()).stem().string();
@@ -32,7 +63,7 @@ int64_t Camera::getTotalDuration_ns() const
 
     for(const auto& pVideo : pVideos_)
     {
-        duration_ns += (int64_t)(pVideo->pVideo_->getDuration_s() * 1e9) + pVideo->frontGap_ns_;
+        duration_ns += (int64_t)(pVideo->getDuration_s() * 1e9) + pVideo->frontGap_ns_;
     }
 
     return duration_ns;
@@ -47,7 +78,7 @@ AVFrame* Camera::getAVFrame(int64_t timestamp_ns)
         const auto pVideo = *iter;
 
         int64_t videoStart = currentOffset_ns + pVideo->frontGap_ns_;
-        int64_t videoEnd = videoStart + pVideo->pVideo_->getDuration_s() * 1e9;
+        int64_t videoEnd = videoStart + pVideo->getDuration_s() * 1e9;
 
         if(videoEnd - timestamp_ns < 1000000000LL && iter != pVideos_.end())
         {
@@ -77,7 +108,7 @@ float Camera::getFrameDeltaTime() const
     if(pVideos_.empty())
         return 0.0f;
 
-    return pVideos_.front()->pVideo_->getFrameDeltaTime();
+    return pVideos_.front()->getFrameDeltaTime();
 }
 
 void Camera::addVideo(std::string name)
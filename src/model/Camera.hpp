@@ -11,12 +11,23 @@ public:
     VideoRecording(std::string videoFilename);
 
     std::string getName() const;
+    void reloadVideo();
+
+    // timing of the original file, pVideo_ may be backed by a proxy with slightly different timing
+    double getDuration_s() const { return duration_s_; }
+    double getFrameDeltaTime() const { return frameDelta_s_; }
 
     std::shared_ptr<MediaSource> pVideo_;
     std::optional<SyncMarker> syncMarker_;
 
     int64_t tStart_ns_; // gamelog t=0 to video t=0
     int64_t frontGap_ns_; // gap between this recording and the previous one
+
+private:
+    void readTiming();
+
+    double duration_s_;
+    double frameDelta_s_;
 };
 
 class Camera
@@ -12,6 +12,7 @@ void Director::orchestrate(const std::vector<RefereeStateChange>& stateChanges,
     sceneBlocks_.clear();
     finalCut_.clear();
     goalCut_.clear();
+    scoreTimes_ns_ = scoreTimes_ns;
 
     if(stateChanges.empty())
         return;
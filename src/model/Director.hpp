@@ -45,6 +45,7 @@ public:
     const std::vector<SceneBlock>& getSceneBlocks() const { return sceneBlocks_; }
     const std::vector<Cut>& getFinalCut() const { return finalCut_; }
     const std::vector<Cut>& getGoalCut() const { return goalCut_; }
+    const std::vector<int64_t>& getScoreTimes() const { return scoreTimes_ns_; }
 
     static SceneState refStateToSceneState(std::shared_ptr<Referee> pRef);
 
@@ -53,4 +54,5 @@ private:
     std::vector<SceneBlock> sceneBlocks_;
     std::vector<Cut> finalCut_;
     std::vector<Cut> goalCut_;
+    std::vector<int64_t> scoreTimes_ns_;
 };
@@ -1,7 +1,10 @@
 #include "Project.hpp"
 #include "util/easylogging++.h"
+#include "util/ThreadPool.hpp"
 #include "nlohmann/json.hpp"
 #include <fstream>
+#include <future>
+#include <algorithm>
 
 using json = nlohmann::json;
 
@@ -88,32 +91,59 @@ void Project::load(std::string filename)
             }
         }
 
-        // Read camera data and video recordings
+        // Read camera data, video recordings are probed in parallel
+        struct PendingRecording
+        {
+            std::shared_ptr<Camera> pCam;
+            json jRec;
+            std::future<std::shared_ptr<VideoRecording>> pRec;
+        };
+
+        std::vector<PendingRecording> pending;
+
+        size_t numRecordings = 0;
         for(auto& jCam : jFile["cameras"])
+            numRecordings += jCam["recordings"].size();
+
         {
-            auto pCam = std::make_shared<Camera>(jCam["name"]);
+            ThreadPool probePool(std::clamp<size_t>(numRecordings, 1, 16));
 
-            for(auto& jRec : jCam["recordings"])
+            for(auto& jCam : jFile["cameras"])
             {
-                fs::path recordingPath = openPrjDir / fs::relative(jRec["path"], savePrjDir);
-                std::shared_ptr<VideoRecording> pRec = std::make_shared<VideoRecording>(recordingPath.string());
+                auto pCam = std::make_shared<Camera>(jCam["name"]);
+
+                for(auto& jRec : jCam["recordings"])
+                {
+                    std::string recordingPath = (openPrjDir / fs::relative(jRec["path"], savePrjDir)).string();
+
+                    pending.push_back(PendingRecording{ pCam, jRec,
+                        probePool.submit([recordingPath]() { return std::make_shared<VideoRecording>(recordingPath); }) });
+                }
+
+                pCameras_.emplace_back(pCam);
+            }
+
+            LOG(INFO) << "Probing " << numRecordings << " recordings with " << probePool.getNumThreads() << " threads.";
+
+            // gather results in project order
+            for(auto& rec : pending)
+            {
+                std::shared_ptr<VideoRecording> pRec = rec.pRec.get();
 
                 if(pRec->pVideo_->isLoaded())
                 {
-                    if(jRec.contains("marker"))
+                    if(rec.jRec.contains("marker"))
                     {
                         SyncMarker marker;
-                        marker.name = jRec["marker"][0];
-                        marker.timestamp_ns = jRec["marker"][1];
+                        marker.name = rec.jRec["marker"][0];
+                        marker.timestamp_ns = rec.jRec["marker"][1];
 
                         pRec->syncMarker_ = marker;
                     }
 
-                    pCam->getVideos().emplace_back(pRec);
+                    rec.pCam->getVideos().emplace_back(pRec);
                 }
             }
-
-            pCameras_.emplace_back(pCam);
         }
 
         filename_ = filename;
@@ -209,7 +239,7 @@ void Project::sync()
             Rec rec;
             rec.synced = false;
             rec.tStart_ns = 0;
-            rec.duration_ns = pRec->pVideo_->getDuration_s() * 1e9;
+            rec.duration_ns = pRec->getDuration_s() * 1e9;
 
             if(pRec->syncMarker_.has_value())
             {
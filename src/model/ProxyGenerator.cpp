@@ -0,0 +1,209 @@
+#include "ProxyGenerator.hpp"
+#include "util/easylogging++.h"
+#include <filesystem>
+#include <algorithm>
+
+ProxyGenerator::ProxyGenerator()
+:workerDone_(false),
+ shouldAbort_(false),
+ totalDuration_s_(0.0),
+ rendered_s_(0.0),
+ pScaler_(0)
+{
+}
+
+ProxyGenerator::~ProxyGenerator()
+{
+    shouldAbort_ = true;
+
+    if(workThread_.joinable())
+        workThread_.join();
+
+    if(pScaler_)
+        sws_freeContext(pScaler_);
+}
+
+void ProxyGenerator::addSource(std::string filename)
+{
+    if(std::filesystem::exists(MediaSource::getProxyFilename(filename)))
+        return;
+
+    if(std::find(sources_.begin(), sources_.end(), filename) != sources_.end())
+        return;
+
+    sources_.push_back(filename);
+}
+
+void ProxyGenerator::start()
+{
+    workThread_ = std::thread(&ProxyGenerator::worker, this);
+}
+
+std::string ProxyGenerator::getCurrentStep() const
+{
+    std::lock_guard<std::mutex> lock(stepMutex_);
+
+    return currentStep_;
+}
+
+void ProxyGenerator::worker()
+{
+    double totalDuration_s = 0.0;
+
+    for(const auto& source : sources_)
+    {
+        MediaSource src(source);
+        if(src.isLoaded())
+            totalDuration_s += src.getDuration_s();
+    }
+
+    totalDuration_s_ = totalDuration_s;
+
+    for(const auto& source : sources_)
+    {
+        {
+            std::lock_guard<std::mutex> lock(stepMutex_);
+            currentStep_ = std::filesystem::path(source).stem().string();
+        }
+
+        if(!generate(source))
+            LOG(ERROR) << "Proxy generation failed for: " << source;
+
+        if(shouldAbort_)
+            break;
+    }
+
+    workerDone_ = true;
+}
+
+bool ProxyGenerator::generate(const std::string& sourceFile)
+{
+    using namespace std::chrono_literals;
+
+    const std::string proxyFile = MediaSource::getProxyFilename(sourceFile);
+
+    // write to a temporary file first, so that aborted runs do not leave incomplete proxies behind
+    std::filesystem::path tmpFile(proxyFile);
+    tmpFile.replace_extension(".tmp.mp4");
+
+    MediaSource src(sourceFile);
+    if(!src.isLoaded())
+        return false;
+
+    LOG(INFO) << "Generating proxy: " << proxyFile;
+
+    const double frameDelta_s = src.getFrameDeltaTime();
+    const double duration_s = src.getDuration_s();
+
+    bool success = true;
+
+    {
+        MediaEncoder enc(tmpFile.string());
+        enc.setGopSize(PROXY_GOP_SIZE);
+        enc.useFastDecode(true);
+        enc.setExpectedDuration(duration_s);
+
+        for(double t = 0.0; t < duration_s; t += frameDelta_s)
+        {
+            src.seekTo(t);
+
+            auto tDecStart = std::chrono::steady_clock::now();
+
+            std::shared_ptr<MediaFrame> pFrame;
+            do
+            {
+                std::this_thread::sleep_for(1ms);
+                pFrame = src.get();
+
+                if(std::chrono::steady_clock::now() - tDecStart > 10s)
+                {
+                    LOG(ERROR) << "Timeout waiting for frame: " << t << ", file: " << sourceFile;
+                    break;
+                }
+            }
+            while(!pFrame && !src.hasReachedEndOfFile() && !src.hasFailed() && !shouldAbort_);
+
+            // only the end of the file completes the proxy, a timeout or abort leaves it incomplete
+            if(!pFrame)
+            {
+                success = src.hasReachedEndOfFile() && !shouldAbort_;
+                break;
+            }
+
+            auto pProxyFrame = scaleFrame(pFrame);
+            if(!pProxyFrame || enc.put(pProxyFrame) < 0)
+            {
+                success = false;
+                break;
+            }
+
+            rendered_s_ = rendered_s_ + frameDelta_s;
+
+            if(shouldAbort_)
+            {
+                success = false;
+                break;
+            }
+        }
+
+        enc.close();
+    }
+
+    std::error_code ec;
+
+    if(!success)
+    {
+        std::filesystem::remove(tmpFile, ec);
+        return false;
+    }
+
+    std::filesystem::rename(tmpFile, proxyFile, ec);
+    if(ec)
+    {
+        LOG(ERROR) << "Could not rename proxy file: " << ec.message();
+        return false;
+    }
+
+    return true;
+}
+
+std::shared_ptr<MediaFrame> ProxyGenerator::scaleFrame(std::shared_ptr<const MediaFrame> pFrame)
+{
+    int result;
+
+    const AVFrame* pSrcImage = *pFrame->pImage;
+
+    // keep aspect ratio, encoder requires even dimensions
+    const int height = std::min(PROXY_HEIGHT, pSrcImage->height);
+    const int width = ((pSrcImage->width * height / pSrcImage->height) + 1) & ~1;
+
+    pScaler_ = sws_getCachedContext(pScaler_, pSrcImage->width, pSrcImage->height, (enum AVPixelFormat)pSrcImage->format,
+                    width, height, AV_PIX_FMT_YUV420P, SWS_BILINEAR, NULL, NULL, NULL);
+    if(!pScaler_)
+    {
+        LOG(ERROR) << "Could not create proxy scaler.";
+        return nullptr;
+    }
+
+    auto pProxyFrame = std::make_shared<MediaFrame>(*pFrame);
+    pProxyFrame->videoBitRate = std::min(PROXY_BIT_RATE, pFrame->videoBitRate);
+    pProxyFrame->pImage = std::make_shared<AVFrameWrapper>();
+
+    AVFrame* pImage = *pProxyFrame->pImage;
+    pImage->format = AV_PIX_FMT_YUV420P;
+    pImage->width = width;
+    pImage->height = height;
+
+    result = av_frame_get_buffer(pImage, 0);
+    if(result < 0)
+    {
+        LOG(ERROR) << "Not enough memory for proxy frame.";
+        return nullptr;
+    }
+
+    av_frame_copy_props(pImage, pSrcImage);
+
+    sws_scale(pScaler_, pSrcImage->data, pSrcImage->linesize, 0, pSrcImage->height, pImage->data, pImage->linesize);
+
+    return pProxyFrame;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "data/MediaSource.hpp"
+#include "data/MediaEncoder.hpp"
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+
+extern "C" {
+#include <libswscale/swscale.h>
+}
+
+// Transcodes recordings into low resolution, short GOP proxies for preview.
+class ProxyGenerator
+{
+public:
+    ProxyGenerator();
+    ~ProxyGenerator();
+
+    void addSource(std::string filename);
+    void start();
+
+    void abort() { shouldAbort_ = true; }
+    float getProgress() const { return totalDuration_s_ > 0.0 ? rendered_s_/totalDuration_s_ : 0.0f; }
+    bool isDone() const { return workerDone_; }
+
+    std::string getCurrentStep() const;
+
+    static constexpr int PROXY_HEIGHT = 540;
+    static constexpr int PROXY_GOP_SIZE = 10;
+    static constexpr int64_t PROXY_BIT_RATE = 3 * 1000 * 1000LL;
+
+private:
+    bool generate(const std::string& sourceFile);
+    std::shared_ptr<MediaFrame> scaleFrame(std::shared_ptr<const MediaFrame> pFrame);
+
+    void worker();
+
+    std::vector<std::string> sources_;
+
+    std::thread workThread_;
+    std::atomic<bool> workerDone_;
+    std::atomic<bool> shouldAbort_;
+
+    std::atomic<double> totalDuration_s_;
+    std::atomic<double> rendered_s_;
+
+    struct SwsContext* pScaler_;
+
+    mutable std::mutex stepMutex_;
+    std::string currentStep_;
+};
@@ -1,8 +1,15 @@
 #include "VideoProducer.hpp"
 #include "util/easylogging++.h"
 #include "data/MediaSource.hpp"
+#include "data/MediaRemuxer.hpp"
+#include "data/MediaSmartRenderer.hpp"
+#include "util/SpscQueue.hpp"
 #include "gui/ScoreBoardFactory.hpp"
+#include <cmath>
 #include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
 
 extern "C" {
 #include <libavutil/imgutils.h>
@@ -14,13 +21,18 @@ VideoProducer::VideoProducer(std::string outputBaseName, std::string scoreBoardT
  workerDone_(false),
  shouldAbort_(false),
  totalDuration_s_(0.0),
- rendered_s_(0.0),
- pResizer_(0),
  perfTotalTime_(0.0f),
  perfDecodingTime_(0.0f),
  perfEncodingTime_(0.0f),
  useHwEncoder_(true),
- useHwDecoder_(true)
+ useHwDecoder_(true),
+ smartRender_(false),
+ fanOut_(true),
+ segmentCache_(false),
+ sceneKeyframes_(true),
+ fragmented_(false),
+ cpuBudget_(std::max(1U, std::thread::hardware_concurrency())),
+ memoryBudget_(DEFAULT_MEMORY_BUDGET)
 {
 }
 
@@ -30,9 +42,6 @@ VideoProducer::~VideoProducer()
 
     if(workThread_.joinable())
         workThread_.join();
-
-    if(pResizer_)
-        sws_freeContext(pResizer_);
 }
 
 void VideoProducer::addCutVideo(std::shared_ptr<GameLog> pGameLog, std::shared_ptr<Camera> pCam)
@@ -43,7 +52,7 @@ void VideoProducer::addCutVideo(std::shared_ptr<GameLog> pGameLog, std::shared_p
         return;
 
     if(pCam)
-        addCutVideo(pCam, finalCut, "cut");
+        addCutVideo(pCam, finalCut, "cut", getKeyframes(pGameLog->getDirector(), finalCut));
     else
         addRenderedVideo(pGameLog, finalCut, "cut");
 }
@@ -56,7 +65,7 @@ void VideoProducer::addGoalVideo(std::shared_ptr<GameLog> pGameLog, std::shared_
         return;
 
     if(pCam)
-        addCutVideo(pCam, goalCut, "goals");
+        addCutVideo(pCam, goalCut, "goals", getKeyframes(pGameLog->getDirector(), goalCut));
     else
         addRenderedVideo(pGameLog, goalCut, "goals");
 }
@@ -71,17 +80,248 @@ void VideoProducer::addArchiveVideo(std::shared_ptr<GameLog> pGameLog, std::shar
     archiveCut.push_back(dCut);
 
     if(pCam)
-        addCutVideo(pCam, archiveCut, "archive");
+        addCutVideo(pCam, archiveCut, "archive", getKeyframes(pGameLog->getDirector(), archiveCut), true);
     else
         addRenderedVideo(pGameLog, archiveCut, "archive");
 }
 
 void VideoProducer::start()
 {
+    // every output file is an independent job
+    totalDuration_s_ = 0.0;
+
+    for(const auto& renderVideo : scoreBoardVideos_)
+    {
+        auto pJob = std::make_unique<Job>(std::filesystem::path(renderVideo.outFile).stem().string(), Job::Type::SCOREBOARD);
+        pJob->pRenderedVideo = &renderVideo;
+        pJob->cpuCost = SCOREBOARD_JOB_CPU;
+        pJob->memoryCost = SCOREBOARD_JOB_MEMORY;
+
+        for(const auto& cut : renderVideo.cut)
+            pJob->duration_s += (cut.tEnd_ns_ - cut.tStart_ns_) * 1e-9;
+
+        totalDuration_s_ += pJob->duration_s;
+        jobs_.push_back(std::move(pJob));
+    }
+
+    // goal videos lie within the final cut, they are copied from its output instead of decoding the recordings again
+    std::map<const CutVideo*, const CutVideo*> derivedVideos;
+
+    for(const auto& goalVideo : outVideos_)
+    {
+        if(goalVideo.typeName != "goals")
+            continue;
+
+        for(const auto& cutVideo : outVideos_)
+        {
+            if(cutVideo.typeName != "cut" || !shareSources(goalVideo, cutVideo))
+                continue;
+
+            std::vector<WrittenPiece> written;
+            for(const auto& piece : cutVideo.pieces)
+                written.push_back(WrittenPiece{ piece, 0.0 });
+
+            std::vector<CutVideo::Piece> mapped;
+            if(mapToOutput(goalVideo.pieces, written, cutVideo.outFile, mapped))
+            {
+                derivedVideos[&goalVideo] = &cutVideo;
+                break;
+            }
+        }
+    }
+
+    // encoded segments are kept next to the outputs, named by everything influencing their content
+    const std::filesystem::path cacheDir = std::filesystem::path(outputBaseName_).parent_path() / "segment-cache";
+    std::map<std::string, Job*> cacheJobs;
+
+    if(segmentCache_)
+    {
+        std::error_code ec;
+        std::filesystem::create_directories(cacheDir, ec);
+        if(ec)
+        {
+            LOG(ERROR) << "Could not create segment cache " << cacheDir.string() << ": " << ec.message();
+            segmentCache_ = false;
+        }
+        else
+        {
+            pruneCache(cacheDir.string());
+        }
+    }
+
+    // outputs using the same recordings are rendered together, every frame is decoded once for all of them
+    std::vector<std::vector<const CutVideo*>> groups;
+
+    for(const auto& outVideo : outVideos_)
+    {
+        if(derivedVideos.count(&outVideo))
+            continue;
+
+        auto isDecoded = [&](const CutVideo& video) { return fanOut_ && !smartRender_ && !segmentCache_ && !video.streamCopy; };
+
+        auto group = std::find_if(groups.begin(), groups.end(), [&](const std::vector<const CutVideo*>& g)
+        {
+            return isDecoded(outVideo) && isDecoded(*g.front()) &&
+                   std::any_of(g.begin(), g.end(), [&](const CutVideo* pVideo) { return shareSources(*pVideo, outVideo); });
+        });
+
+        if(group != groups.end())
+            group->push_back(&outVideo);
+        else
+            groups.push_back({ &outVideo });
+    }
+
+    for(const auto& group : groups)
+    {
+        if(group.size() > 1)
+        {
+            // shared decoding and segmented encoding compete, such groups are rendered in one job
+            std::string name;
+            for(const CutVideo* pVideo : group)
+                name += (name.empty() ? "" : "+") + std::filesystem::path(pVideo->outFile).stem().string();
+
+            auto pJob = std::make_unique<Job>(name, Job::Type::CUT);
+            pJob->cpuCost = (useHwEncoder_ ? CUT_JOB_CPU_HW : CUT_JOB_CPU) * group.size();
+            pJob->memoryCost = CUT_JOB_MEMORY * group.size();
+
+            for(const CutVideo* pVideo : group)
+            {
+                pJob->cutVideos.push_back(*pVideo);
+
+                for(const auto& piece : pVideo->pieces)
+                    pJob->duration_s += piece.duration_s;
+            }
+
+            totalDuration_s_ += pJob->duration_s;
+            jobs_.push_back(std::move(pJob));
+            continue;
+        }
+
+        const CutVideo& outVideo = *group.front();
+        std::vector<CutVideo> segments = segmentCache_ ? splitCutVideoForCache(outVideo, SEGMENT_DURATION_S) : splitCutVideo(outVideo, SEGMENT_DURATION_S);
+
+        auto pConcatJob = std::make_unique<Job>(std::filesystem::path(outVideo.outFile).stem().string(), Job::Type::CONCAT);
+        pConcatJob->outFile = outVideo.outFile;
+        pConcatJob->cpuCost = CONCAT_JOB_CPU;
+        pConcatJob->memoryCost = CONCAT_JOB_MEMORY;
+
+        // segments completed by an interrupted export of this output
+        const std::string journalFile = outVideo.outFile + ".journal";
+        const std::map<std::string, std::string> journal = readJournal(journalFile);
+
+        for(auto& segment : segments)
+        {
+            std::string cacheFile;
+
+            if(segmentCache_)
+            {
+                const std::string key = getCacheKey(segment);
+                const std::string extension = std::filesystem::path(outVideo.outFile).extension().string();
+
+                cacheFile = (cacheDir / (key + extension)).string();
+                segment.outFile = (cacheDir / (key + ".part" + extension)).string();
+
+                pConcatJob->segmentFiles.push_back(cacheFile);
+
+                if(std::filesystem::exists(cacheFile))
+                {
+                    LOG(INFO) << "Reusing segment " << cacheFile << " for " << outVideo.outFile;
+
+                    // keeps it from being pruned as unused
+                    std::error_code ec;
+                    std::filesystem::last_write_time(cacheFile, std::filesystem::file_time_type::clock::now(), ec);
+
+                    pConcatJob->writtenPieces[cacheFile] = layoutPieces(segment.pieces);
+                    continue;
+                }
+
+                // the same piece may be used twice, it is rendered once
+                const auto scheduled = cacheJobs.find(cacheFile);
+                if(scheduled != cacheJobs.end())
+                {
+                    if(std::find(pConcatJob->dependencies.begin(), pConcatJob->dependencies.end(), scheduled->second) == pConcatJob->dependencies.end())
+                        pConcatJob->dependencies.push_back(scheduled->second);
+
+                    continue;
+                }
+            }
+
+            const std::string segmentName = std::filesystem::path(segment.outFile).filename().string();
+            const auto journalEntry = journal.find(segmentName);
+
+            if(cacheFile.empty() && segments.size() > 1 && journalEntry != journal.end() &&
+               journalEntry->second == getCacheKey(segment) && std::filesystem::exists(segment.outFile))
+            {
+                LOG(INFO) << "Resuming " << outVideo.outFile << ", segment " << segmentName << " is complete";
+
+                pConcatJob->segmentFiles.push_back(segment.outFile);
+                pConcatJob->writtenPieces[segment.outFile] = layoutPieces(segment.pieces);
+                continue;
+            }
+
+            auto pJob = std::make_unique<Job>(std::filesystem::path(segment.outFile).stem().string(), Job::Type::CUT);
+            pJob->cutVideos.push_back(segment);
+            pJob->cpuCost = segment.streamCopy ? COPY_JOB_CPU : (useHwEncoder_ ? CUT_JOB_CPU_HW : CUT_JOB_CPU);
+            pJob->memoryCost = CUT_JOB_MEMORY;
+
+            for(const auto& piece : segment.pieces)
+                pJob->duration_s += piece.duration_s;
+
+            if(cacheFile.empty())
+            {
+                pConcatJob->segmentFiles.push_back(segment.outFile);
+
+                if(segments.size() > 1)
+                    pJob->journalFile = journalFile;
+            }
+            else
+            {
+                pJob->cacheFile = cacheFile;
+                cacheJobs[cacheFile] = pJob.get();
+            }
+
+            pConcatJob->dependencies.push_back(pJob.get());
+
+            totalDuration_s_ += pJob->duration_s;
+            jobs_.push_back(std::move(pJob));
+        }
+
+        // cached segments are always concatenated to keep them in the cache
+        if(segments.size() > 1 || segmentCache_)
+            jobs_.push_back(std::move(pConcatJob));
+    }
+
+    for(const auto& derived : derivedVideos)
+    {
+        const CutVideo& outVideo = *derived.first;
+        const std::string& baseFile = derived.second->outFile;
+
+        // the job writing the complete base file, a concatenation or a job rendering it in one piece
+        auto producer = std::find_if(jobs_.begin(), jobs_.end(), [&](const std::unique_ptr<Job>& pJob)
+        {
+            return pJob->outFile == baseFile || (pJob->type == Job::Type::CUT &&
+                   std::any_of(pJob->cutVideos.begin(), pJob->cutVideos.end(), [&](const CutVideo& v) { return v.outFile == baseFile; }));
+        });
+
+        auto pJob = std::make_unique<Job>(std::filesystem::path(outVideo.outFile).stem().string(), Job::Type::CUT);
+        pJob->cutVideos.push_back(outVideo);
+        pJob->baseFile = baseFile;
+        if(producer != jobs_.end())
+            pJob->dependencies.push_back(producer->get());
+        pJob->cpuCost = COPY_JOB_CPU;
+        pJob->memoryCost = CUT_JOB_MEMORY;
+
+        for(const auto& piece : outVideo.pieces)
+            pJob->duration_s += piece.duration_s;
+
+        totalDuration_s_ += pJob->duration_s;
+        jobs_.push_back(std::move(pJob));
+    }
+
     workThread_ = std::thread(&VideoProducer::worker, this);
 }
 
-void VideoProducer::addCutVideo(const std::shared_ptr<Camera>& pCam, const std::vector<Director::Cut>& directorsCut, std::string typeName)
+void VideoProducer::addCutVideo(const std::shared_ptr<Camera>& pCam, const std::vector<Director::Cut>& directorsCut, std::string typeName, const std::vector<double>& keyframes_s, bool streamCopy)
 {
     if(pCam->getVideos().empty())
     {
@@ -93,6 +333,9 @@ void VideoProducer::addCutVideo(const std::shared_ptr<Camera>& pCam, const std::
 
     CutVideo cutVideo;
     cutVideo.outFile = outputBaseName_ + typeName + "-" + pCam->getName() + ".mp4";
+    cutVideo.typeName = typeName;
+    cutVideo.streamCopy = streamCopy;
+    cutVideo.keyframes_s = keyframes_s;
 
     for(const auto& cut : directorsCut)
     {
@@ -114,6 +357,49 @@ void VideoProducer::addRenderedVideo(const std::shared_ptr<GameLog>& pGameLog, c
     scoreBoardVideos_.push_back(renderVideo);
 }
 
+std::vector<double> VideoProducer::getKeyframes(const Director& director, const std::vector<Director::Cut>& directorsCut)
+{
+    std::vector<double> keyframes_s;
+
+    for(const auto& cut : directorsCut)
+        keyframes_s.push_back(cut.tStart_ns_ * 1e-9);
+
+    for(const auto& block : director.getSceneBlocks())
+        keyframes_s.push_back(block.tStart_ns_ * 1e-9);
+
+    // goal scenes start on a keyframe, so the goal video can be copied from the cut video
+    for(const auto& goal : director.getGoalCut())
+        keyframes_s.push_back(goal.tStart_ns_ * 1e-9);
+
+    for(const auto& scoreTime : director.getScoreTimes())
+        keyframes_s.push_back(scoreTime * 1e-9);
+
+    std::sort(keyframes_s.begin(), keyframes_s.end());
+    keyframes_s.erase(std::unique(keyframes_s.begin(), keyframes_s.end()), keyframes_s.end());
+
+    return keyframes_s;
+}
+
+std::vector<double> VideoProducer::getOutputKeyframes(const CutVideo& video)
+{
+    // game times to output times, points outside of all pieces are not part of this output
+    std::vector<double> keyframes_s;
+    double tOut_s = 0.0;
+
+    for(const auto& piece : video.pieces)
+    {
+        for(const double tGame_s : video.keyframes_s)
+        {
+            if(tGame_s >= piece.tGame_s && tGame_s < piece.tGame_s + piece.duration_s)
+                keyframes_s.push_back(tOut_s + tGame_s - piece.tGame_s);
+        }
+
+        tOut_s += piece.duration_s;
+    }
+
+    return keyframes_s;
+}
+
 std::vector<CutVideo::Piece> VideoProducer::fillCut(const Director::Cut& cut, const std::vector<std::shared_ptr<VideoRecording>>& recordings)
 {
     // t_gamelog - tStart = t_rec
@@ -127,7 +413,7 @@ std::vector<CutVideo::Piece> VideoProducer::fillCut(const Director::Cut& cut, co
     for(const auto& rec : recordings)
     {
         int64_t tRecStart_ns = rec->tStart_ns_;
-        int64_t tRecDuration_ns = rec->pVideo_->getDuration_s() * 1e9;
+        int64_t tRecDuration_ns = rec->getDuration_s() * 1e9;
         int64_t tRecEnd_ns = tRecStart_ns + tRecDuration_ns;
 
         if(tRecEnd_ns < tCutWritePos_ns)
@@ -147,6 +433,7 @@ std::vector<CutVideo::Piece> VideoProducer::fillCut(const Director::Cut& cut, co
             piece.sourceFile.clear();
             piece.tStart_s = 0.0;
             piece.duration_s = missingDuration_ns * 1e-9;
+            piece.tGame_s = tCutWritePos_ns * 1e-9;
             pieces.push_back(piece);
 
             tCutWritePos_ns = tRecStart_ns;
@@ -167,6 +454,7 @@ std::vector<CutVideo::Piece> VideoProducer::fillCut(const Director::Cut& cut, co
             piece.sourceFile = rec->pVideo_->getFilename();
             piece.tStart_s = (tCutWritePos_ns - tRecStart_ns) * 1e-9;
             piece.duration_s = useableRecDuration_ns * 1e-9;
+            piece.tGame_s = tCutWritePos_ns * 1e-9;
             pieces.push_back(piece);
 
             tCutWritePos_ns += useableRecDuration_ns;
@@ -184,6 +472,7 @@ std::vector<CutVideo::Piece> VideoProducer::fillCut(const Director::Cut& cut, co
         piece.sourceFile.clear();
         piece.tStart_s = 0.0;
         piece.duration_s = tCutDurationLeft_ns * 1e-9;
+        piece.tGame_s = tCutWritePos_ns * 1e-9;
         pieces.push_back(piece);
     }
 
@@ -195,327 +484,1213 @@ std::vector<CutVideo::Piece> VideoProducer::fillCut(const Director::Cut& cut, co
     return pieces;
 }
 
-std::shared_ptr<MediaFrame> VideoProducer::blImageToMediaFrame(const BLImageData& image)
+std::vector<TimeRange> VideoProducer::getSchedule(const std::vector<CutVideo::Piece>& pieces, size_t firstPiece)
 {
-    int result;
-
-    auto pMediaFrame = std::make_shared<MediaFrame>();
-    pMediaFrame->pSamples = nullptr;
-
-    pMediaFrame->videoTimeBase = av_make_q(1, 50);
-    pMediaFrame->videoFramerate = av_make_q(50, 1);
-    pMediaFrame->videoCodec = AV_CODEC_ID_H264;
-    pMediaFrame->videoBitRate = 10 * 1000 * 1000LL;
+    // all following pieces from the same source, until another source is used
+    std::vector<TimeRange> schedule;
 
-    pMediaFrame->pImage = std::make_shared<AVFrameWrapper>();
-    AVFrame* pFrame = *(pMediaFrame->pImage);
+    for(size_t i = firstPiece; i < pieces.size(); i++)
+    {
+        if(pieces[i].sourceFile.empty())
+            continue;
 
-    pFrame->format = AV_PIX_FMT_YUV420P;
-    pFrame->width = image.size.w;
-    pFrame->height = image.size.h;
-    pFrame->pts = 0;
-    pFrame->pkt_dts = 0;
+        if(pieces[i].sourceFile != pieces[firstPiece].sourceFile)
+            break;
 
-    result = av_frame_get_buffer(pFrame, 0);
-    if(result < 0)
-    {
-        LOG(ERROR) << "Not enough memory for YUV frame.";
-        return nullptr;
+        schedule.push_back(TimeRange{ pieces[i].tStart_s, pieces[i].tStart_s + pieces[i].duration_s });
     }
 
-    auto pRGBFrameWrapper = std::make_shared<AVFrameWrapper>();
-    AVFrame* pRGBFrame = *pRGBFrameWrapper;
-
-    pRGBFrame->format = AV_PIX_FMT_BGRA;
-    pRGBFrame->width = image.size.w;
-    pRGBFrame->height = image.size.h;
+    return schedule;
+}
 
-    result = av_frame_get_buffer(pRGBFrame, 0);
-    if(result < 0)
-    {
-        LOG(ERROR) << "Not enough memory for RGB frame.";
-        return nullptr;
-    }
+std::vector<TimeRange> VideoProducer::mergeSchedule(std::vector<TimeRange> schedule)
+{
+    std::sort(schedule.begin(), schedule.end(), [](const TimeRange& a, const TimeRange& b) { return a.tStart_s < b.tStart_s; });
 
-    memcpy(pRGBFrame->data[0], image.pixelData, image.stride * image.size.h);
+    std::vector<TimeRange> merged;
 
-    result = sws_scale(pResizer_, (const uint8_t* const*)pRGBFrame->data, pRGBFrame->linesize, 0, pRGBFrame->height, pFrame->data, pFrame->linesize);
-    if(result < 0)
+    for(const auto& range : schedule)
     {
-        LOG(ERROR) << "Format conversion failed: " << result;
-        return nullptr;
+        if(!merged.empty() && range.tStart_s <= merged.back().tEnd_s)
+            merged.back().tEnd_s = std::max(merged.back().tEnd_s, range.tEnd_s);
+        else
+            merged.push_back(range);
     }
 
-    return pMediaFrame;
+    return merged;
 }
 
-void VideoProducer::wipeFrame(std::shared_ptr<MediaFrame> pFrame)
+bool VideoProducer::shareSources(const CutVideo& a, const CutVideo& b)
 {
-    if(pFrame->pImage)
+    for(const auto& pieceA : a.pieces)
     {
-        AVFrame* pImage = *pFrame->pImage;
-
-        const AVPixelFormat format = static_cast<AVPixelFormat>(pImage->format);
-        const int planes = av_pix_fmt_count_planes(format);
-
-        ptrdiff_t linesizes[4];
-        for (int i = 0; i < planes; ++i)
-            linesizes[i] = pImage->linesize[i];
+        if(pieceA.sourceFile.empty())
+            continue;
 
-        av_image_fill_black(pImage->data, linesizes, format, pImage->color_range, pImage->width, pImage->height);
+        for(const auto& pieceB : b.pieces)
+        {
+            if(pieceA.sourceFile == pieceB.sourceFile)
+                return true;
+        }
     }
 
-    if(pFrame->pSamples)
-    {
-        AVFrame* pAudio = *pFrame->pSamples;
-        av_samples_set_silence(pAudio->data, 0, pAudio->nb_samples, pAudio->channels, (enum AVSampleFormat)pAudio->format);
-    }
+    return false;
 }
 
-void VideoProducer::worker()
+bool VideoProducer::mapToOutput(const std::vector<CutVideo::Piece>& pieces, const std::vector<WrittenPiece>& written, const std::string& outFile, std::vector<CutVideo::Piece>& mapped)
 {
-    using namespace std::chrono_literals;
+    mapped.clear();
 
-    totalDuration_s_ = 0.0;
-    rendered_s_ = 0.0;
-
-    for(const auto& outVideo : outVideos_)
+    for(const auto& piece : pieces)
     {
-        for(const auto& piece : outVideo.pieces)
+        if(piece.sourceFile.empty())
         {
-            totalDuration_s_ += piece.duration_s;
+            mapped.push_back(piece);
+            continue;
         }
-    }
 
-    for(const auto& renderVideo : scoreBoardVideos_)
-    {
-        for(const auto& cut : renderVideo.cut)
+        auto iter = std::find_if(written.begin(), written.end(), [&](const WrittenPiece& w)
         {
-            totalDuration_s_ += (cut.tEnd_ns_ - cut.tStart_ns_) * 1e-9;
-        }
+            return w.piece.sourceFile == piece.sourceFile && piece.tStart_s >= w.piece.tStart_s - 1e-3 &&
+                   piece.tStart_s + piece.duration_s <= w.piece.tStart_s + w.piece.duration_s + 1e-3;
+        });
+
+        if(iter == written.end())
+            return false;
+
+        CutVideo::Piece outPiece = piece;
+        outPiece.sourceFile = outFile;
+        outPiece.tStart_s = iter->tOut_s + std::max(0.0, piece.tStart_s - iter->piece.tStart_s);
+
+        mapped.push_back(outPiece);
     }
 
-    tWorkerStart_ = std::chrono::high_resolution_clock::now();
+    return true;
+}
 
-    for(const auto& renderVideo : scoreBoardVideos_)
-    {
-        GameLog source(renderVideo.sourceFile);
+void VideoProducer::deriveFromBase(Job& job)
+{
+    CutVideo& video = job.cutVideos.front();
 
-        currentStep_ = std::filesystem::path(renderVideo.outFile).stem().string();
+    for(const Job* pDep : job.dependencies)
+    {
+        const auto iter = pDep->writtenPieces.find(job.baseFile);
+        if(iter == pDep->writtenPieces.end())
+            continue;
 
-        while(!source.isLoaded())
-            std::this_thread::sleep_for(10ms);
+        std::vector<CutVideo::Piece> mapped;
+        if(!mapToOutput(video.pieces, iter->second, job.baseFile, mapped))
+            break;
 
-        MediaEncoder enc(renderVideo.outFile);
+        LOG(INFO) << "Copying " << video.outFile << " from " << job.baseFile;
 
-        auto pBoard = ScoreBoardFactory::create(scoreBoardType_);
+        video.pieces = mapped;
+        video.streamCopy = true;
+        return;
+    }
 
-        auto imgData = pBoard->getImageData();
+    LOG(INFO) << "Pieces of " << video.outFile << " are not in " << job.baseFile << ", rendering from recordings.";
+}
 
-        pResizer_ = sws_getContext(imgData.size.w, imgData.size.h, AV_PIX_FMT_BGRA, imgData.size.w, imgData.size.h,
-                        AV_PIX_FMT_YUV420P, SWS_BILINEAR, NULL, NULL, NULL);
-        if(!pResizer_)
-        {
-            LOG(ERROR) << "Could not create resizer.";
-            return;
-        }
+std::vector<CutVideo> VideoProducer::splitCutVideo(const CutVideo& video, double segmentDuration_s)
+{
+    double totalDuration_s = 0.0;
+    for(const auto& piece : video.pieces)
+        totalDuration_s += piece.duration_s;
 
-        const int64_t tInc_ns = 20 * 1000 * 1000LL;
+    // not worth the concatenation
+    if(totalDuration_s < 2.0 * segmentDuration_s)
+        return { video };
 
-        for(const auto& cut : renderVideo.cut)
-        {
-            for(int64_t t = cut.tStart_ns_; t < cut.tEnd_ns_; t += tInc_ns)
-            {
-                source.seekTo(t);
-                auto optEntry = source.get();
+    std::vector<CutVideo> segments;
+    CutVideo segment;
+    segment.streamCopy = video.streamCopy;
+    segment.keyframes_s = video.keyframes_s;
+    double segmentLeft_s = segmentDuration_s;
 
-                if(optEntry)
-                {
-                    pBoard->update(*optEntry->pReferee_);
-                }
-                else
-                {
-                    // TODO: not fatal? just use last image?
-                    LOG(ERROR) << "Unable to get gamelog entry???";
-                    return;
-                }
+    for(const auto& piece : video.pieces)
+    {
+        CutVideo::Piece rest = piece;
 
-                auto pFrame = blImageToMediaFrame(pBoard->getImageData());
+        while(rest.duration_s > 1e-6)
+        {
+            CutVideo::Piece part = rest;
+            part.duration_s = std::min(rest.duration_s, segmentLeft_s);
 
-                if(enc.put(pFrame) < 0)
-                {
-                    LOG(ERROR) << "Encoding score board failed. " << renderVideo.outFile;
-                    return;
-                }
+            // copied segments end at a keyframe of the source, otherwise both sides of the split need a partial GOP encoded
+            const bool splitsPiece = part.duration_s < rest.duration_s - 1e-6;
+            if(splitsPiece && video.streamCopy && !part.sourceFile.empty())
+            {
+                const double tKeyframe_s = MediaSmartRenderer::findKeyframe_s(part.sourceFile, part.tStart_s + part.duration_s);
+                if(tKeyframe_s > part.tStart_s + MediaSmartRenderer::MIN_COPY_DURATION_S)
+                    part.duration_s = tKeyframe_s - part.tStart_s;
+            }
 
-                lastVideoTiming_ = enc.getVideoTiming();
-                lastAudioTiming_ = enc.getAudioTiming();
+            segment.pieces.push_back(part);
+            segmentLeft_s -= part.duration_s;
 
-                rendered_s_ += tInc_ns * 1e-9;
+            rest.duration_s -= part.duration_s;
+            rest.tGame_s += part.duration_s;
+            if(!rest.sourceFile.empty())
+                rest.tStart_s += part.duration_s;
 
-                if(shouldAbort_)
-                {
-                    workerDone_ = true;
-                    return;
-                }
+            if(segmentLeft_s <= 1e-6 || splitsPiece)
+            {
+                segments.push_back(segment);
+                segment.pieces.clear();
+                segmentLeft_s = segmentDuration_s;
             }
         }
+    }
 
-        enc.close();
+    if(!segment.pieces.empty())
+        segments.push_back(segment);
 
-        if(pResizer_)
+    // every segment needs a source to derive the output format from, merge those without one
+    for(size_t i = 0; i < segments.size() && segments.size() > 1; )
+    {
+        const bool hasSource = std::any_of(segments[i].pieces.begin(), segments[i].pieces.end(), [](const CutVideo::Piece& p){ return !p.sourceFile.empty(); });
+        if(hasSource)
         {
-            sws_freeContext(pResizer_);
-            pResizer_ = 0;
+            i++;
+            continue;
         }
-    }
 
-    auto tScoreBoardComplete = std::chrono::high_resolution_clock::now();
+        if(i > 0)
+        {
+            auto& prev = segments[i-1].pieces;
+            prev.insert(prev.end(), segments[i].pieces.begin(), segments[i].pieces.end());
+        }
+        else
+        {
+            auto& next = segments[1].pieces;
+            next.insert(next.begin(), segments[0].pieces.begin(), segments[0].pieces.end());
+        }
 
-    float scoreBoardTime = std::chrono::duration_cast<std::chrono::microseconds>(tScoreBoardComplete - tWorkerStart_).count() * 1e-6f;
+        segments.erase(segments.begin() + i);
+    }
 
-    const float alpha = 0.95f;
-    std::map<std::string, float> videoTimes;
+    std::filesystem::path outFile(video.outFile);
 
-    for(const auto& outVideo : outVideos_)
+    for(size_t i = 0; i < segments.size(); i++)
     {
-        auto tVideoEncStart = std::chrono::high_resolution_clock::now();
+        char ext[32];
+        snprintf(ext, sizeof(ext), ".seg%03d%s", (int)i, outFile.extension().string().c_str());
 
-        MediaEncoder enc(outVideo.outFile, useHwEncoder_);
+        segments[i].outFile = std::filesystem::path(outFile).replace_extension(ext).string();
+    }
 
-        currentStep_ = std::filesystem::path(outVideo.outFile).stem().string();
+    if(segments.size() == 1)
+        segments[0].outFile = video.outFile;
 
-        auto firstPieceWithSource = std::find_if(outVideo.pieces.begin(), outVideo.pieces.end(), [](const CutVideo::Piece& p){ return !p.sourceFile.empty(); });
-        if(firstPieceWithSource == outVideo.pieces.end())
-        {
-            LOG(ERROR) << "Video has no sources at all???";
-            continue;
-        }
+    LOG(INFO) << "Splitting " << video.outFile << " (" << totalDuration_s << "s) into " << segments.size() << " segments";
 
-        std::unique_ptr<MediaSource> pSrc = std::make_unique<MediaSource>(firstPieceWithSource->sourceFile, useHwDecoder_);
-        const double frameDelta_s = pSrc->getFrameDeltaTime();
-        pSrc->seekTo(0.0);
+    return segments;
+}
 
-        // generate an empty frame from this base data (black image, silent audio)
-        std::shared_ptr<MediaFrame> pEmptyFrame;
-        do
+std::vector<CutVideo> VideoProducer::splitCutVideoForCache(const CutVideo& video, double segmentDuration_s)
+{
+    // bounds depend only on the pieces themselves, changing one piece keeps the segments of all others valid
+    std::vector<CutVideo> segments;
+    std::vector<CutVideo::Piece> blanks;
+
+    for(const auto& piece : video.pieces)
+    {
+        // pieces without source need the format of a neighbour
+        if(piece.sourceFile.empty())
         {
-            pEmptyFrame = pSrc->get();
-            std::this_thread::sleep_for(1ms);
+            if(segments.empty())
+                blanks.push_back(piece);
+            else
+                segments.back().pieces.push_back(piece);
+
+            continue;
         }
-        while(!pEmptyFrame);
 
-        wipeFrame(pEmptyFrame);
+        CutVideo::Piece rest = piece;
 
-        for(const auto& piece : outVideo.pieces)
+        while(rest.duration_s > 1e-6)
         {
-            if(piece.sourceFile.empty())
-            {
-                // no source, insert black
-                for(double t = 0.0; t < piece.duration_s; t += frameDelta_s)
-                {
-                    std::chrono::high_resolution_clock::time_point tEncStart = std::chrono::high_resolution_clock::now();
-
-                    enc.put(pEmptyFrame);
-                    rendered_s_ += frameDelta_s;
+            // long pieces are split on a fixed grid of their recording
+            const double tGrid_s = (std::floor(rest.tStart_s / segmentDuration_s + 1e-9) + 1.0) * segmentDuration_s;
 
-                    lastVideoTiming_ = enc.getVideoTiming();
-                    lastAudioTiming_ = enc.getAudioTiming();
+            CutVideo::Piece part = rest;
+            part.duration_s = std::min(rest.duration_s, tGrid_s - rest.tStart_s);
 
-                    std::chrono::high_resolution_clock::time_point tEncEnd = std::chrono::high_resolution_clock::now();
+            CutVideo segment;
+            segment.typeName = video.typeName;
+            segment.streamCopy = video.streamCopy;
+            segment.keyframes_s = video.keyframes_s;
+            segment.pieces = blanks;
+            segment.pieces.push_back(part);
+            segments.push_back(segment);
 
-                    float totalTime = std::chrono::duration_cast<std::chrono::microseconds>(tEncEnd - tEncStart).count() * 1e-6f;
-                    float decodingTime = 0.0f;
-                    float encodingTime = totalTime;
+            blanks.clear();
 
-                    perfTotalTime_ = alpha*perfTotalTime_ + (1.0f-alpha)*totalTime;
-                    perfDecodingTime_ = alpha*perfDecodingTime_ + (1.0f-alpha)*decodingTime;
-                    perfEncodingTime_ = alpha*perfEncodingTime_ + (1.0f-alpha)*encodingTime;
+            rest.duration_s -= part.duration_s;
+            rest.tStart_s += part.duration_s;
+            rest.tGame_s += part.duration_s;
+        }
+    }
+
+    if(segments.empty())
+    {
+        CutVideo segment = video;
+        segments.push_back(segment);
+    }
+
+    LOG(INFO) << "Splitting " << video.outFile << " into " << segments.size() << " cacheable segments";
+
+    return segments;
+}
+
+std::string VideoProducer::getCacheKey(const CutVideo& segment) const
+{
+    std::ostringstream desc;
+    desc << SEGMENT_CACHE_VERSION << "|" << useHwEncoder_ << "|" << (smartRender_ || segment.streamCopy) << std::fixed << std::setprecision(6);
+
+    for(const auto& piece : segment.pieces)
+    {
+        desc << "|" << piece.sourceFile << "," << piece.tStart_s << "," << piece.duration_s;
+
+        // recordings replaced on disk must not hit old segments
+        if(!piece.sourceFile.empty())
+        {
+            std::error_code ec;
+            desc << "," << std::filesystem::file_size(piece.sourceFile, ec) << "," << std::filesystem::last_write_time(piece.sourceFile, ec).time_since_epoch().count();
+        }
+    }
+
+    if(sceneKeyframes_)
+    {
+        for(const double tOut_s : getOutputKeyframes(segment))
+            desc << "|k" << tOut_s;
+    }
+
+    // FNV-1a, unlike std::hash it is the same in every run
+    uint64_t hash = 14695981039346656037ULL;
+    for(unsigned char c : desc.str())
+    {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+
+    char key[32];
+    snprintf(key, sizeof(key), "%016llx", (unsigned long long)hash);
+
+    return key;
+}
+
+void VideoProducer::storeInCache(Job& job)
+{
+    const std::string partFile = job.cutVideos.front().outFile;
+    std::error_code ec;
+
+    // incomplete segments must never be reused
+    if(shouldAbort_ || job.failed || !std::filesystem::exists(partFile))
+    {
+        std::filesystem::remove(partFile, ec);
+        return;
+    }
+
+    std::filesystem::rename(partFile, job.cacheFile, ec);
+    if(ec)
+    {
+        LOG(ERROR) << "Could not store segment " << job.cacheFile << ": " << ec.message();
+        return;
+    }
+
+    auto iter = job.writtenPieces.find(partFile);
+    if(iter != job.writtenPieces.end())
+    {
+        job.writtenPieces[job.cacheFile] = iter->second;
+        job.writtenPieces.erase(iter);
+    }
+}
+
+void VideoProducer::pruneCache(const std::string& cacheDir)
+{
+    struct CacheEntry
+    {
+        std::filesystem::path path;
+        std::filesystem::file_time_type tLastUse;
+        uintmax_t size;
+    };
+
+    std::vector<CacheEntry> entries;
+    uintmax_t totalSize = 0;
+    std::error_code ec;
+
+    for(const auto& file : std::filesystem::directory_iterator(cacheDir, ec))
+    {
+        if(!file.is_regular_file(ec))
+            continue;
+
+        const uintmax_t size = file.file_size(ec);
+        if(ec)
+            continue;
+
+        entries.push_back(CacheEntry{ file.path(), file.last_write_time(ec), size });
+        totalSize += size;
+    }
+
+    if(totalSize <= SEGMENT_CACHE_MAX_BYTES)
+        return;
+
+    std::sort(entries.begin(), entries.end(), [](const CacheEntry& a, const CacheEntry& b){ return a.tLastUse < b.tLastUse; });
+
+    for(const auto& entry : entries)
+    {
+        if(totalSize <= SEGMENT_CACHE_MAX_BYTES)
+            break;
+
+        if(std::filesystem::remove(entry.path, ec))
+        {
+            LOG(INFO) << "Pruning segment " << entry.path.string() << " from cache";
+            totalSize -= entry.size;
+        }
+    }
+}
+
+std::vector<VideoProducer::WrittenPiece> VideoProducer::layoutPieces(const std::vector<CutVideo::Piece>& pieces)
+{
+    std::vector<WrittenPiece> written;
+    double tOut_s = 0.0;
+
+    for(const auto& piece : pieces)
+    {
+        written.push_back(WrittenPiece{ piece, tOut_s });
+        tOut_s += piece.duration_s;
+    }
+
+    return written;
+}
+
+std::map<std::string, std::string> VideoProducer::readJournal(const std::string& journalFile)
+{
+    // one line per completed segment: cache key of its pieces and file name
+    std::map<std::string, std::string> entries;
+
+    std::ifstream journal(journalFile);
+    std::string key;
+    std::string segmentName;
+
+    while(journal >> key && std::getline(journal >> std::ws, segmentName))
+        entries[segmentName] = key;
+
+    return entries;
+}
+
+void VideoProducer::writeJournal(const Job& job)
+{
+    const CutVideo& segment = job.cutVideos.front();
+
+    if(!std::filesystem::exists(segment.outFile))
+        return;
+
+    // a segment cut short, e.g. by a skipped piece, is rendered again on resume
+    double plannedDuration_s = 0.0;
+    for(const auto& piece : segment.pieces)
+        plannedDuration_s += piece.duration_s;
+
+    const double writtenDuration_s = MediaRemuxer::probeDuration_s(segment.outFile);
+    if(writtenDuration_s < plannedDuration_s - JOURNAL_DURATION_TOLERANCE_S)
+    {
+        LOG(ERROR) << "Segment " << segment.outFile << " is incomplete, " << writtenDuration_s << "s of " << plannedDuration_s << "s, not journaled.";
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(journalMutex_);
+
+    std::ofstream journal(job.journalFile, std::ios::app);
+    journal << getCacheKey(segment) << " " << std::filesystem::path(segment.outFile).filename().string() << std::endl;
+
+    if(!journal)
+        LOG(ERROR) << "Could not write journal " << job.journalFile;
+}
+
+std::shared_ptr<MediaFrame> VideoProducer::blImageToMediaFrame(const BLImageData& image, struct SwsContext* pResizer)
+{
+    int result;
+
+    auto pMediaFrame = std::make_shared<MediaFrame>();
+    pMediaFrame->pSamples = nullptr;
+
+    pMediaFrame->videoTimeBase = av_make_q(1, 50);
+    pMediaFrame->videoFramerate = av_make_q(50, 1);
+    pMediaFrame->videoCodec = AV_CODEC_ID_H264;
+    pMediaFrame->videoBitRate = 10 * 1000 * 1000LL;
+
+    pMediaFrame->pImage = std::make_shared<AVFrameWrapper>();
+    AVFrame* pFrame = *(pMediaFrame->pImage);
+
+    pFrame->format = AV_PIX_FMT_YUV420P;
+    pFrame->width = image.size.w;
+    pFrame->height = image.size.h;
+    pFrame->pts = 0;
+    pFrame->pkt_dts = 0;
+
+    result = av_frame_get_buffer(pFrame, 0);
+    if(result < 0)
+    {
+        LOG(ERROR) << "Not enough memory for YUV frame.";
+        return nullptr;
+    }
+
+    auto pRGBFrameWrapper = std::make_shared<AVFrameWrapper>();
+    AVFrame* pRGBFrame = *pRGBFrameWrapper;
+
+    pRGBFrame->format = AV_PIX_FMT_BGRA;
+    pRGBFrame->width = image.size.w;
+    pRGBFrame->height = image.size.h;
+
+    result = av_frame_get_buffer(pRGBFrame, 0);
+    if(result < 0)
+    {
+        LOG(ERROR) << "Not enough memory for RGB frame.";
+        return nullptr;
+    }
+
+    memcpy(pRGBFrame->data[0], image.pixelData, image.stride * image.size.h);
+
+    result = sws_scale(pResizer, (const uint8_t* const*)pRGBFrame->data, pRGBFrame->linesize, 0, pRGBFrame->height, pFrame->data, pFrame->linesize);
+    if(result < 0)
+    {
+        LOG(ERROR) << "Format conversion failed: " << result;
+        return nullptr;
+    }
+
+    return pMediaFrame;
+}
+
+void VideoProducer::wipeFrame(std::shared_ptr<MediaFrame> pFrame)
+{
+    if(pFrame->pImage)
+    {
+        AVFrame* pImage = *pFrame->pImage;
+
+        const AVPixelFormat format = static_cast<AVPixelFormat>(pImage->format);
+        const int planes = av_pix_fmt_count_planes(format);
+
+        ptrdiff_t linesizes[4];
+        for (int i = 0; i < planes; ++i)
+            linesizes[i] = pImage->linesize[i];
+
+        av_image_fill_black(pImage->data, linesizes, format, pImage->color_range, pImage->width, pImage->height);
+    }
+
+    if(pFrame->pSamples)
+    {
+        AVFrame* pAudio = *pFrame->pSamples;
+        av_samples_set_silence(pAudio->data, 0, pAudio->nb_samples, pAudio->channels, (enum AVSampleFormat)pAudio->format);
+    }
+}
+
+void VideoProducer::worker()
+{
+    tWorkerStart_ = std::chrono::high_resolution_clock::now();
+
+    // longest jobs first, short ones fill the gaps at the end
+    std::vector<Job*> pendingJobs;
+    for(auto& pJob : jobs_)
+        pendingJobs.push_back(pJob.get());
+
+    std::stable_sort(pendingJobs.begin(), pendingJobs.end(), [](const Job* pA, const Job* pB) { return pA->duration_s > pB->duration_s; });
+
+    std::mutex budgetMutex;
+    std::condition_variable budgetCv;
+    unsigned int usedCpu = 0;
+    size_t usedMemory = 0;
+
+    std::vector<std::thread> jobThreads;
+
+    std::unique_lock<std::mutex> lock(budgetMutex);
+
+    while(!pendingJobs.empty() && !shouldAbort_)
+    {
+        // first job which is ready and fits into the remaining budget, a single job is always allowed
+        auto next = std::find_if(pendingJobs.begin(), pendingJobs.end(), [&](const Job* pJob)
+        {
+            const bool ready = std::all_of(pJob->dependencies.begin(), pJob->dependencies.end(), [](const Job* pDep) { return pDep->done.load(); });
+
+            return ready && (usedCpu == 0 || (usedCpu + pJob->cpuCost <= cpuBudget_ && usedMemory + pJob->memoryCost <= memoryBudget_));
+        });
+
+        if(next == pendingJobs.end())
+        {
+            budgetCv.wait(lock);
+            continue;
+        }
+
+        Job* pJob = *next;
+        pendingJobs.erase(next);
+
+        usedCpu += pJob->cpuCost;
+        usedMemory += pJob->memoryCost;
+
+        LOG(INFO) << "Starting job " << pJob->name << ", duration: " << pJob->duration_s << "s, cpu: " << usedCpu << "/" << cpuBudget_
+                  << ", memory: " << (usedMemory >> 20) << "MB/" << (memoryBudget_ >> 20) << "MB";
+
+        jobThreads.emplace_back([&, pJob]()
+        {
+            runJob(*pJob);
+
+            std::lock_guard<std::mutex> jobLock(budgetMutex);
+            usedCpu -= pJob->cpuCost;
+            usedMemory -= pJob->memoryCost;
+
+            budgetCv.notify_all();
+        });
+    }
+
+    lock.unlock();
+
+    for(auto& thread : jobThreads)
+        thread.join();
+
+    LOG(INFO) << "VideoProducer done. Timing: ";
+    for(const auto& pJob : jobs_)
+        LOG(INFO) << pJob->name << ": " << pJob->renderTime_s;
+
+    workerDone_ = true;
+}
+
+void VideoProducer::runJob(Job& job)
+{
+    auto tJobStart = std::chrono::high_resolution_clock::now();
+
+    job.running = true;
+
+    switch(job.type)
+    {
+        case Job::Type::SCOREBOARD: renderScoreBoardVideo(job); break;
+        case Job::Type::CUT: renderCutVideo(job); break;
+        case Job::Type::CONCAT: concatSegments(job); break;
+    }
+
+    if(!job.cacheFile.empty())
+        storeInCache(job);
+
+    if(!job.journalFile.empty() && !job.failed && !shouldAbort_)
+        writeJournal(job);
+
+    job.running = false;
+    job.done = true;
+
+    auto tJobEnd = std::chrono::high_resolution_clock::now();
+    job.renderTime_s = std::chrono::duration_cast<std::chrono::microseconds>(tJobEnd - tJobStart).count() * 1e-6f;
+}
+
+void VideoProducer::renderScoreBoardVideo(Job& job)
+{
+    using namespace std::chrono_literals;
+
+    const RenderedVideo& renderVideo = *job.pRenderedVideo;
+
+    GameLog source(renderVideo.sourceFile);
+
+    while(!source.isLoaded())
+        std::this_thread::sleep_for(10ms);
+
+    MediaEncoder enc(renderVideo.outFile);
+    enc.useFragments(fragmented_);
+
+    auto pBoard = ScoreBoardFactory::create(scoreBoardType_);
+
+    auto imgData = pBoard->getImageData();
+
+    struct SwsContext* pResizer = sws_getContext(imgData.size.w, imgData.size.h, AV_PIX_FMT_BGRA, imgData.size.w, imgData.size.h,
+                    AV_PIX_FMT_YUV420P, SWS_BILINEAR, NULL, NULL, NULL);
+    if(!pResizer)
+    {
+        LOG(ERROR) << "Could not create resizer.";
+        return;
+    }
+
+    const int64_t tInc_ns = 20 * 1000 * 1000LL;
+
+    for(const auto& cut : renderVideo.cut)
+    {
+        for(int64_t t = cut.tStart_ns_; t < cut.tEnd_ns_; t += tInc_ns)
+        {
+            source.seekTo(t);
+            auto optEntry = source.get();
+
+            if(optEntry)
+            {
+                pBoard->update(*optEntry->pReferee_);
+            }
+            else
+            {
+                // TODO: not fatal? just use last image?
+                LOG(ERROR) << "Unable to get gamelog entry???";
+                sws_freeContext(pResizer);
+                return;
+            }
+
+            auto pFrame = blImageToMediaFrame(pBoard->getImageData(), pResizer);
+
+            if(enc.put(pFrame) < 0)
+            {
+                LOG(ERROR) << "Encoding score board failed. " << renderVideo.outFile;
+                sws_freeContext(pResizer);
+                return;
+            }
+
+            updateTiming(enc);
+
+            addRendered(job, tInc_ns * 1e-9);
+
+            if(shouldAbort_)
+            {
+                sws_freeContext(pResizer);
+                return;
+            }
+        }
+    }
+
+    enc.close();
+
+    sws_freeContext(pResizer);
+}
+
+void VideoProducer::concatSegments(Job& job)
+{
+    for(const auto& segmentFile : job.segmentFiles)
+    {
+        if(!std::filesystem::exists(segmentFile))
+        {
+            LOG(ERROR) << "Segment " << segmentFile << " is missing, not creating " << job.outFile;
+            return;
+        }
+    }
+
+    MediaRemuxer remuxer(job.outFile);
+    remuxer.useFragments(fragmented_);
+
+    std::vector<WrittenPiece>& written = job.writtenPieces[job.outFile];
+
+    for(const auto& segmentFile : job.segmentFiles)
+    {
+        const double tSegmentStart_s = remuxer.getDuration_s();
 
-                    if(shouldAbort_)
+        if(!remuxer.append(segmentFile) || shouldAbort_)
+            return;
+
+        // segments split pieces, continuous parts are joined again, segments reused from the cache are listed in this job
+        std::vector<const Job*> sources = job.dependencies;
+        sources.push_back(&job);
+
+        for(const Job* pDep : sources)
+        {
+            const auto iter = pDep->writtenPieces.find(segmentFile);
+            if(iter == pDep->writtenPieces.end())
+                continue;
+
+            for(WrittenPiece part : iter->second)
+            {
+                part.tOut_s += tSegmentStart_s;
+
+                if(!written.empty())
+                {
+                    CutVideo::Piece& last = written.back().piece;
+
+                    if(!last.sourceFile.empty() && last.sourceFile == part.piece.sourceFile &&
+                       std::abs(last.tStart_s + last.duration_s - part.piece.tStart_s) < 1e-3)
                     {
-                        workerDone_ = true;
-                        return;
+                        last.duration_s += part.piece.duration_s;
+                        continue;
                     }
                 }
+
+                written.push_back(part);
             }
-            else
+
+            break;
+        }
+    }
+
+    if(!remuxer.close() || segmentCache_)
+        return;
+
+    for(const auto& segmentFile : job.segmentFiles)
+        std::filesystem::remove(segmentFile);
+
+    std::error_code ec;
+    std::filesystem::remove(job.outFile + ".journal", ec);
+}
+
+bool VideoProducer::renderSmartCutVideo(Job& job)
+{
+    const CutVideo& outVideo = job.cutVideos.front();
+
+    std::vector<std::string> sourceFiles;
+
+    for(const auto& piece : outVideo.pieces)
+    {
+        if(!piece.sourceFile.empty() && std::find(sourceFiles.begin(), sourceFiles.end(), piece.sourceFile) == sourceFiles.end())
+            sourceFiles.push_back(piece.sourceFile);
+    }
+
+    if(!MediaSmartRenderer::isCompatible(sourceFiles))
+        return false;
+
+    MediaSmartRenderer renderer(outVideo.outFile, shouldAbort_);
+    renderer.useFragments(fragmented_);
+
+    std::vector<WrittenPiece> written;
+    double tOut_s = 0.0;
+
+    for(const auto& piece : outVideo.pieces)
+    {
+        written.push_back(WrittenPiece{ piece, tOut_s });
+        tOut_s += piece.duration_s;
+
+        // gaps are filled with black frames in the format of the first source
+        bool success;
+        if(piece.sourceFile.empty())
+            success = renderer.appendFiller(sourceFiles.front(), piece.duration_s);
+        else
+            success = renderer.append(piece.sourceFile, piece.tStart_s, piece.duration_s);
+
+        if(!success)
+        {
+            if(!shouldAbort_)
+                LOG(ERROR) << "Smart rendering " << outVideo.outFile << " failed, encoding it completely.";
+
+            renderer.close();
+            job.rendered_s = 0.0;
+            return shouldAbort_;
+        }
+
+        addRendered(job, piece.duration_s);
+    }
+
+    job.writtenPieces[outVideo.outFile] = written;
+
+    return renderer.close();
+}
+
+void VideoProducer::renderCutVideo(Job& job)
+{
+    using namespace std::chrono_literals;
+
+    const float alpha = 0.95f;
+
+    // pieces mapped to the base file can only be copied, decoding falls back to the recordings
+    std::vector<CutVideo> originalVideos;
+
+    if(!job.baseFile.empty())
+    {
+        originalVideos = job.cutVideos;
+        deriveFromBase(job);
+    }
+
+    if(job.cutVideos.size() == 1 && (smartRender_ || job.cutVideos.front().streamCopy) && renderSmartCutVideo(job))
+        return;
+
+    if(!originalVideos.empty())
+        job.cutVideos = originalVideos;
+
+    const CutVideo* pFirstVideo = nullptr;
+    const CutVideo::Piece* pFirstPiece = nullptr;
+
+    for(const auto& video : job.cutVideos)
+    {
+        auto iter = std::find_if(video.pieces.begin(), video.pieces.end(), [](const CutVideo::Piece& p){ return !p.sourceFile.empty(); });
+        if(iter != video.pieces.end())
+        {
+            pFirstVideo = &video;
+            pFirstPiece = &(*iter);
+            break;
+        }
+    }
+
+    if(!pFirstPiece)
+    {
+        LOG(ERROR) << "Video has no sources at all???";
+        job.failed = true;
+        return;
+    }
+
+    std::unique_ptr<MediaSource> pSrc = std::make_unique<MediaSource>(pFirstPiece->sourceFile, useHwDecoder_);
+    pSrc->setSchedule(getSchedule(pFirstVideo->pieces, pFirstPiece - pFirstVideo->pieces.data()));
+
+    std::unique_ptr<MediaSource> pNextSrc;
+
+    const double frameDelta_s = pSrc->getFrameDeltaTime();
+    pSrc->seekTo(0.0);
+
+    // generate an empty frame from this base data (black image, silent audio)
+    std::shared_ptr<MediaFrame> pEmptyFrame;
+    const auto tEmptyStart = std::chrono::steady_clock::now();
+
+    while(!shouldAbort_ && !pSrc->hasFailed() && std::chrono::steady_clock::now() - tEmptyStart < 10s)
+    {
+        pEmptyFrame = pSrc->waitForFrame(100ms);
+        if(pEmptyFrame)
+            break;
+    }
+
+    if(!pEmptyFrame)
+    {
+        if(!shouldAbort_)
+        {
+            LOG(ERROR) << "Could not decode " << pSrc->getFilename();
+            job.failed = true;
+        }
+
+        return;
+    }
+
+    wipeFrame(pEmptyFrame);
+
+    // decoding runs in this thread for all outputs, each output is encoded in a separate one, frames are handed over via bounded queues
+    struct QueuedFrame
+    {
+        std::shared_ptr<MediaFrame> pFrame;
+        int numFillerFrames; // gaps are sent once and repeated by the encoder
+    };
+
+    struct Output
+    {
+        Output(const CutVideo& video, bool useHwEncoder) :video(video), enc(video.outFile, useHwEncoder), frameQueue(FRAME_QUEUE_SIZE), encodingFailed(false) {}
+
+        const CutVideo& video;
+        MediaEncoder enc;
+        SpscQueue<QueuedFrame> frameQueue;
+        std::thread encodeThread;
+        std::atomic<bool> encodingFailed;
+
+        // next frame to decode for this output
+        size_t iPiece = 0;
+        int frame = 0;
+        int numFrames = -1;
+
+        int64_t framesWritten = 0;
+        int64_t framesPlanned = 0;
+    };
+
+    std::vector<std::unique_ptr<Output>> outputs;
+
+    for(const auto& video : job.cutVideos)
+    {
+        auto pOutput = std::make_unique<Output>(video, useHwEncoder_);
+
+        double outDuration_s = 0.0;
+        for(const auto& piece : video.pieces)
+        {
+            outDuration_s += piece.duration_s;
+
+            for(double t = 0.0; t < piece.duration_s; t += frameDelta_s)
+                pOutput->framesPlanned++;
+        }
+
+        pOutput->enc.setExpectedDuration(outDuration_s);
+        pOutput->enc.useFragments(fragmented_);
+        if(sceneKeyframes_)
+            pOutput->enc.setKeyframeTimes(getOutputKeyframes(video));
+
+        pOutput->encodeThread = std::thread([&, &out = *pOutput]()
+        {
+            std::chrono::high_resolution_clock::time_point tLastFrame = std::chrono::high_resolution_clock::now();
+
+            while(!shouldAbort_)
             {
-                if(pSrc->getFilename() != piece.sourceFile)
+                QueuedFrame queued;
+                if(!out.frameQueue.popWait(queued, [&]() { return shouldAbort_.load(); }))
+                    break;
+
+                // empty frame marks the end of the video
+                if(!queued.pFrame)
+                    break;
+
+                std::chrono::high_resolution_clock::time_point tEncStart = std::chrono::high_resolution_clock::now();
+
+                const int result = queued.numFillerFrames > 0 ? out.enc.putFiller(queued.pFrame, queued.numFillerFrames) : out.enc.put(queued.pFrame);
+                if(result < 0)
                 {
-                    pSrc = std::make_unique<MediaSource>(piece.sourceFile, useHwDecoder_);
+                    LOG(ERROR) << "Encoding video " << out.video.outFile << " failed.";
+                    out.encodingFailed = true;
+                    break;
                 }
 
-                pSrc->seekTo(piece.tStart_s);
+                updateTiming(out.enc);
+
+                std::chrono::high_resolution_clock::time_point tEncEnd = std::chrono::high_resolution_clock::now();
+
+                float totalTime = std::chrono::duration_cast<std::chrono::microseconds>(tEncEnd - tLastFrame).count() * 1e-6f;
+                float encodingTime = std::chrono::duration_cast<std::chrono::microseconds>(tEncEnd - tEncStart).count() * 1e-6f;
 
+                updatePerf(perfTotalTime_, totalTime, alpha);
+                updatePerf(perfEncodingTime_, encodingTime, alpha);
+
+                tLastFrame = tEncEnd;
+
+                addRendered(job, frameDelta_s * std::max(1, queued.numFillerFrames));
+            }
+        });
+
+        outputs.push_back(std::move(pOutput));
+    }
+
+    // blocks while the queue is full, fails if encoding stopped
+    auto pushFrame = [&](Output& out, std::shared_ptr<MediaFrame> pFrame, int numFillerFrames = 0)
+    {
+        return out.frameQueue.pushWait(QueuedFrame{ pFrame, numFillerFrames }, [&]() { return shouldAbort_ || out.encodingFailed; });
+    };
+
+    // moves an output to its next frame from a source, pieces without source are handed over as a whole
+    auto settle = [&](Output& out)
+    {
+        const auto& pieces = out.video.pieces;
+
+        while(out.iPiece < pieces.size())
+        {
+            const auto& piece = pieces[out.iPiece];
+
+            if(out.numFrames < 0)
+            {
+                out.numFrames = 0;
                 for(double t = 0.0; t < piece.duration_s; t += frameDelta_s)
+                    out.numFrames++;
+
+                job.writtenPieces[out.video.outFile].push_back(WrittenPiece{ piece, out.framesWritten * frameDelta_s });
+            }
+
+            if(!piece.sourceFile.empty() && out.frame < out.numFrames)
+                return;
+
+            if(piece.sourceFile.empty() && out.numFrames > 0)
+            {
+                // no source, insert black
+                updatePerf(perfDecodingTime_, 0.0f, alpha);
+
+                if(!pushFrame(out, pEmptyFrame, out.numFrames))
                 {
-                    pSrc->seekTo(piece.tStart_s + t);
+                    out.iPiece = pieces.size();
+                    return;
+                }
 
-                    std::chrono::high_resolution_clock::time_point tDecStart = std::chrono::high_resolution_clock::now();
+                out.framesWritten += out.numFrames;
+            }
 
-                    // wait until frame is available
-                    std::shared_ptr<MediaFrame> pFrame;
-                    do
-                    {
-                        std::this_thread::yield();
-                        pFrame = pSrc->get();
-
-                        if(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - tDecStart).count() > 10000)
-                        {
-                            LOG(ERROR) << "Timeout waiting for frame: " << t << ", file: " << pSrc->getFilename() << ", dur: " << pSrc->getDuration_s() << ", tell: " << pSrc->tell();
-                            break;
-                        }
-                    }
-                    while(!pFrame && !pSrc->hasReachedEndOfFile());
+            out.iPiece++;
+            out.frame = 0;
+            out.numFrames = -1;
+        }
+    };
 
-                    if(!pFrame)
-                        break;
+    // time ranges of all outputs in this source, starting at their current pieces
+    auto getSourceSchedule = [&](const std::string& sourceFile)
+    {
+        std::vector<TimeRange> schedule;
 
-                    std::chrono::high_resolution_clock::time_point tDecEnd = std::chrono::high_resolution_clock::now();
+        for(const auto& pOut : outputs)
+        {
+            const auto& pieces = pOut->video.pieces;
+            auto iter = std::find_if(pieces.begin() + std::min(pOut->iPiece, pieces.size()), pieces.end(), [&](const CutVideo::Piece& p){ return p.sourceFile == sourceFile; });
 
-                    if(enc.put(pFrame) < 0)
-                    {
-                        LOG(ERROR) << "Encoding video " << outVideo.outFile << " failed.";
-                        break;
-                    }
+            if(iter != pieces.end())
+            {
+                auto ranges = getSchedule(pieces, iter - pieces.begin());
+                schedule.insert(schedule.end(), ranges.begin(), ranges.end());
+            }
+        }
 
-                    lastVideoTiming_ = enc.getVideoTiming();
-                    lastAudioTiming_ = enc.getAudioTiming();
+        return mergeSchedule(schedule);
+    };
 
-                    std::chrono::high_resolution_clock::time_point tEncEnd = std::chrono::high_resolution_clock::now();
+    for(auto& pOut : outputs)
+        settle(*pOut);
 
-                    float totalTime = std::chrono::duration_cast<std::chrono::microseconds>(tEncEnd - tDecStart).count() * 1e-6f;
-                    float decodingTime = std::chrono::duration_cast<std::chrono::microseconds>(tDecEnd - tDecStart).count() * 1e-6f;
-                    float encodingTime = std::chrono::duration_cast<std::chrono::microseconds>(tEncEnd - tDecEnd).count() * 1e-6f;
+    while(!shouldAbort_)
+    {
+        // all outputs walk through the game in the same direction, the one furthest behind is served next
+        Output* pNext = nullptr;
+        double tNextGame_s = 0.0;
 
-                    perfTotalTime_ = alpha*perfTotalTime_ + (1.0f-alpha)*totalTime;
-                    perfDecodingTime_ = alpha*perfDecodingTime_ + (1.0f-alpha)*decodingTime;
-                    perfEncodingTime_ = alpha*perfEncodingTime_ + (1.0f-alpha)*encodingTime;
+        for(auto& pOut : outputs)
+        {
+            if(pOut->iPiece >= pOut->video.pieces.size() || pOut->encodingFailed)
+                continue;
 
-                    rendered_s_ += frameDelta_s;
+            const double tGame_s = pOut->video.pieces[pOut->iPiece].tGame_s + pOut->frame * frameDelta_s;
 
-                    if(shouldAbort_)
-                    {
-                        workerDone_ = true;
-                        return;
-                    }
-                }
+            if(!pNext || tGame_s < tNextGame_s)
+            {
+                pNext = pOut.get();
+                tNextGame_s = tGame_s;
+            }
+        }
+
+        if(!pNext)
+            break;
+
+        const auto& piece = pNext->video.pieces[pNext->iPiece];
+        const double t = piece.tStart_s + pNext->frame * frameDelta_s;
+
+        if(pSrc->getFilename() != piece.sourceFile)
+        {
+            if(pNextSrc && pNextSrc->getFilename() == piece.sourceFile)
+                pSrc = std::move(pNextSrc);
+            else
+                pSrc = std::make_unique<MediaSource>(piece.sourceFile, useHwDecoder_);
+
+            pSrc->setSchedule(getSourceSchedule(piece.sourceFile));
+        }
+
+        // open the source of the next piece early, so that it seeks and decodes while this piece is encoded
+        if(!pNextSrc)
+        {
+            const auto& pieces = pNext->video.pieces;
+            auto nextPiece = std::find_if(pieces.begin() + pNext->iPiece + 1, pieces.end(), [](const CutVideo::Piece& p){ return !p.sourceFile.empty(); });
+            if(nextPiece != pieces.end() && nextPiece->sourceFile != piece.sourceFile)
+            {
+                pNextSrc = std::make_unique<MediaSource>(nextPiece->sourceFile, useHwDecoder_);
+                pNextSrc->seekTo(nextPiece->tStart_s);
+            }
+        }
+
+        pSrc->seekTo(t);
+
+        std::chrono::high_resolution_clock::time_point tDecStart = std::chrono::high_resolution_clock::now();
+
+        // wait until frame is available, the decoding thread wakes us up
+        std::shared_ptr<MediaFrame> pFrame;
+        do
+        {
+            pFrame = pSrc->waitForFrame(100ms);
+
+            if(!pFrame && std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - tDecStart).count() > 10000)
+            {
+                LOG(ERROR) << "Timeout waiting for frame: " << t << ", file: " << pSrc->getFilename() << ", dur: " << pSrc->getDuration_s() << ", tell: " << pSrc->tell();
+                break;
+            }
+        }
+        while(!pFrame && !pSrc->hasReachedEndOfFile() && !pSrc->hasFailed() && !shouldAbort_);
+
+        if(!pFrame)
+        {
+            // skip the rest of this piece
+            pNext->frame = pNext->numFrames;
+            settle(*pNext);
+            continue;
+        }
+
+        std::chrono::high_resolution_clock::time_point tDecEnd = std::chrono::high_resolution_clock::now();
+
+        float decodingTime = std::chrono::duration_cast<std::chrono::microseconds>(tDecEnd - tDecStart).count() * 1e-6f;
+
+        updatePerf(perfDecodingTime_, decodingTime, alpha);
+
+        // every output needing the same source frame gets it
+        const int64_t frameIndex = std::llround(t / frameDelta_s);
+
+        for(auto& pOut : outputs)
+        {
+            if(pOut->iPiece >= pOut->video.pieces.size() || pOut->encodingFailed)
+                continue;
+
+            const auto& outPiece = pOut->video.pieces[pOut->iPiece];
+            const double tOut = outPiece.tStart_s + pOut->frame * frameDelta_s;
+
+            if(outPiece.sourceFile != piece.sourceFile || std::llround(tOut / frameDelta_s) != frameIndex)
+                continue;
+
+            if(!pushFrame(*pOut, pFrame))
+            {
+                pOut->iPiece = pOut->video.pieces.size();
+                continue;
             }
+
+            pOut->frame++;
+            pOut->framesWritten++;
+            settle(*pOut);
         }
+    }
+
+    // end marker, the encoder is gone if it failed or the export was aborted
+    for(auto& pOut : outputs)
+    {
+        pushFrame(*pOut, nullptr);
+        pOut->encodeThread.join();
+    }
+
+    if(shouldAbort_)
+        return;
 
-        enc.close();
+    for(auto& pOut : outputs)
+    {
+        if(pOut->encodingFailed)
+            job.failed = true;
+
+        // skipped pieces leave the output short, it must not be cached or journaled as complete
+        if(pOut->framesWritten < pOut->framesPlanned)
+        {
+            LOG(ERROR) << "Video " << pOut->video.outFile << " is incomplete, " << pOut->framesWritten << " of " << pOut->framesPlanned << " frames written.";
+            job.failed = true;
+        }
 
-        auto tVideoEncEnd = std::chrono::high_resolution_clock::now();
-        videoTimes[outVideo.outFile] = std::chrono::duration_cast<std::chrono::microseconds>(tVideoEncEnd - tVideoEncStart).count() * 1e-6f;
+        pOut->enc.close();
     }
+}
 
-    LOG(INFO) << "VideoProducer done. Timing: ";
-    LOG(INFO) << "Score board: " << scoreBoardTime;
-    for(const auto& t : videoTimes)
-        LOG(INFO) << t.first << ": " << t.second;
+void VideoProducer::addRendered(Job& job, double s)
+{
+    // outputs of a fan-out job report from their own encode threads
+    double rendered_s = job.rendered_s;
+    while(!job.rendered_s.compare_exchange_weak(rendered_s, rendered_s + s));
+}
 
-    workerDone_ = true;
+void VideoProducer::updatePerf(float& perf, float sample, float alpha)
+{
+    std::lock_guard<std::mutex> lock(perfMutex_);
+
+    perf = alpha*perf + (1.0f-alpha)*sample;
+}
+
+void VideoProducer::updateTiming(const MediaEncoder& enc)
+{
+    std::lock_guard<std::mutex> lock(perfMutex_);
+
+    lastVideoTiming_ = enc.getVideoTiming();
+    lastAudioTiming_ = enc.getAudioTiming();
+}
+
+float VideoProducer::getPerfTotalTime() const
+{
+    std::lock_guard<std::mutex> lock(perfMutex_);
+
+    return perfTotalTime_;
+}
+
+float VideoProducer::getPerfDecodingTime() const
+{
+    std::lock_guard<std::mutex> lock(perfMutex_);
+
+    return perfDecodingTime_;
+}
+
+float VideoProducer::getPerfEncodingTime() const
+{
+    std::lock_guard<std::mutex> lock(perfMutex_);
+
+    return perfEncodingTime_;
+}
+
+MediaEncoder::Timing VideoProducer::getLastVideoTiming() const
+{
+    std::lock_guard<std::mutex> lock(perfMutex_);
+
+    return lastVideoTiming_;
+}
+
+MediaEncoder::Timing VideoProducer::getLastAudioTiming() const
+{
+    std::lock_guard<std::mutex> lock(perfMutex_);
+
+    return lastAudioTiming_;
 }
 
 float VideoProducer::getElapsedTime() const
@@ -525,5 +1700,38 @@ float VideoProducer::getElapsedTime() const
 
 float VideoProducer::getEstimatedTimeLeft() const
 {
-    return getElapsedTime() * totalDuration_s_ / rendered_s_ - getElapsedTime();
+    return getElapsedTime() * totalDuration_s_ / getRendered_s() - getElapsedTime();
+}
+
+float VideoProducer::getProgress() const
+{
+    return getRendered_s() / totalDuration_s_;
+}
+
+double VideoProducer::getRendered_s() const
+{
+    double rendered_s = 0.0;
+
+    for(const auto& pJob : jobs_)
+        rendered_s += pJob->rendered_s;
+
+    return rendered_s;
+}
+
+std::string VideoProducer::getCurrentStep() const
+{
+    std::string step;
+
+    for(const auto& pJob : jobs_)
+    {
+        if(!pJob->running)
+            continue;
+
+        if(!step.empty())
+            step += ", ";
+
+        step += pJob->name;
+    }
+
+    return step;
 }
@@ -3,6 +3,7 @@
 #include "Project.hpp"
 #include "gui/AScoreBoard.hpp"
 #include "data/MediaEncoder.hpp"
+#include <map>
 #include <queue>
 
 extern "C" {
@@ -16,10 +17,18 @@ struct CutVideo
         std::string sourceFile;
         double tStart_s;
         double duration_s;
+        double tGame_s;
     };
 
     std::string outFile;
+    std::string typeName;
     std::vector<Piece> pieces;
+
+    // game times which start a new GOP in the output
+    std::vector<double> keyframes_s;
+
+    // packets are copied from the sources instead of being re-encoded
+    bool streamCopy = false;
 };
 
 struct RenderedVideo
@@ -40,60 +49,192 @@ public:
     void addArchiveVideo(std::shared_ptr<GameLog> pGameLog, std::shared_ptr<Camera> pCam);
     void useHwDecoder(bool enable) { useHwDecoder_ = enable; }
     void useHwEncoder(bool enable) { useHwEncoder_ = enable; }
+
+    // copy unchanged GOPs of cut videos from the source, only re-encode frames around cuts
+    void useSmartRender(bool enable) { smartRender_ = enable; }
+
+    // decode recordings once for all outputs of a camera instead of once per output
+    void useFanOut(bool enable) { fanOut_ = enable; }
+
+    // keep encoded segments next to the outputs and reuse those whose pieces and settings did not change
+    void useSegmentCache(bool enable) { segmentCache_ = enable; }
+
+    // start a closed GOP at every scene change, cut and goal, so outputs can be trimmed there losslessly
+    void useSceneKeyframes(bool enable) { sceneKeyframes_ = enable; }
+
+    // outputs and segments can be watched while they are rendered
+    void useFragmentedOutput(bool enable) { fragmented_ = enable; }
+
+    // output files are rendered in parallel as long as they fit into these budgets
+    void setCpuBudget(unsigned int numCores) { cpuBudget_ = numCores; }
+    void setMemoryBudget(size_t bytes) { memoryBudget_ = bytes; }
+
     void start();
 
     void abort() { shouldAbort_ = true; }
-    float getProgress() const { return rendered_s_/totalDuration_s_; }
+    float getProgress() const;
     bool isDone() const { return workerDone_; }
 
-    float getPerfTotalTime() const { return perfTotalTime_; }
-    float getPerfDecodingTime() const { return perfDecodingTime_; }
-    float getPerfEncodingTime() const { return perfEncodingTime_; }
+    float getPerfTotalTime() const;
+    float getPerfDecodingTime() const;
+    float getPerfEncodingTime() const;
 
     float getElapsedTime() const;
     float getEstimatedTimeLeft() const;
 
-    std::string getCurrentStep() const { return currentStep_; }
+    std::string getCurrentStep() const;
 
-    MediaEncoder::Timing getLastVideoTiming() const { return lastVideoTiming_; }
-    MediaEncoder::Timing getLastAudioTiming() const { return lastAudioTiming_; }
+    MediaEncoder::Timing getLastVideoTiming() const;
+    MediaEncoder::Timing getLastAudioTiming() const;
 
 private:
-    void addCutVideo(const std::shared_ptr<Camera>& pCam, const std::vector<Director::Cut>& directorsCut, std::string typeName);
+    // where a piece of a cut video ended up in the output file
+    struct WrittenPiece
+    {
+        CutVideo::Piece piece;
+        double tOut_s;
+    };
+
+    struct Job
+    {
+        enum class Type
+        {
+            SCOREBOARD,
+            CUT,
+            CONCAT,
+        };
+
+        Job(std::string name, Type type) :name(name), type(type), pRenderedVideo(0), duration_s(0.0), cpuCost(0), memoryCost(0), rendered_s(0.0), running(false), done(false), failed(false), renderTime_s(0.0f) {}
+
+        std::string name;
+        Type type;
+        const RenderedVideo* pRenderedVideo;
+
+        // outputs rendered from a single pass over their sources
+        std::vector<CutVideo> cutVideos;
+
+        // concatenation of segments rendered by other jobs
+        std::string outFile;
+        std::vector<std::string> segmentFiles;
+        std::vector<const Job*> dependencies;
+
+        // segment is rendered to a temporary file and moved here when complete
+        std::string cacheFile;
+
+        // completed segments are recorded here, a restarted export skips them
+        std::string journalFile;
+
+        // cut videos are copied from this output of a dependency if it contains all their pieces
+        std::string baseFile;
+
+        // written pieces per output file, valid when done
+        std::map<std::string, std::vector<WrittenPiece>> writtenPieces;
+
+        double duration_s;
+        unsigned int cpuCost;
+        size_t memoryCost;
+
+        std::atomic<double> rendered_s;
+        std::atomic<bool> running;
+        std::atomic<bool> done;
+        std::atomic<bool> failed;
+        float renderTime_s;
+    };
+
+    void addCutVideo(const std::shared_ptr<Camera>& pCam, const std::vector<Director::Cut>& directorsCut, std::string typeName, const std::vector<double>& keyframes_s, bool streamCopy = false);
     void addRenderedVideo(const std::shared_ptr<GameLog>& pGameLog, const std::vector<Director::Cut>& directorsCut, std::string typeName);
+    static std::vector<double> getKeyframes(const Director& director, const std::vector<Director::Cut>& directorsCut);
+    static std::vector<double> getOutputKeyframes(const CutVideo& video);
     std::vector<CutVideo::Piece> fillCut(const Director::Cut& cut, const std::vector<std::shared_ptr<VideoRecording>>& recordings);
-
-    std::shared_ptr<MediaFrame> blImageToMediaFrame(const BLImageData& image);
+    std::vector<TimeRange> getSchedule(const std::vector<CutVideo::Piece>& pieces, size_t firstPiece);
+    static std::vector<TimeRange> mergeSchedule(std::vector<TimeRange> schedule);
+    static bool shareSources(const CutVideo& a, const CutVideo& b);
+    static bool mapToOutput(const std::vector<CutVideo::Piece>& pieces, const std::vector<WrittenPiece>& written, const std::string& outFile, std::vector<CutVideo::Piece>& mapped);
+    void deriveFromBase(Job& job);
+    std::vector<CutVideo> splitCutVideo(const CutVideo& video, double segmentDuration_s);
+    std::vector<CutVideo> splitCutVideoForCache(const CutVideo& video, double segmentDuration_s);
+    std::string getCacheKey(const CutVideo& segment) const;
+    void storeInCache(Job& job);
+    static void pruneCache(const std::string& cacheDir);
+    static std::vector<WrittenPiece> layoutPieces(const std::vector<CutVideo::Piece>& pieces);
+    static std::map<std::string, std::string> readJournal(const std::string& journalFile);
+    void writeJournal(const Job& job);
+
+    std::shared_ptr<MediaFrame> blImageToMediaFrame(const BLImageData& image, struct SwsContext* pResizer);
     void wipeFrame(std::shared_ptr<MediaFrame> pFrame);
 
+    double getRendered_s() const;
+    static void addRendered(Job& job, double s);
+
+    // several jobs and encoders report concurrently
+    void updatePerf(float& perf, float sample, float alpha);
+    void updateTiming(const MediaEncoder& enc);
+
     void worker();
+    void runJob(Job& job);
+    void renderScoreBoardVideo(Job& job);
+    void renderCutVideo(Job& job);
+    bool renderSmartCutVideo(Job& job);
+    void concatSegments(Job& job);
 
     std::string outputBaseName_;
     std::string scoreBoardType_;
 
     std::vector<CutVideo> outVideos_;
     std::vector<RenderedVideo> scoreBoardVideos_;
+    std::vector<std::unique_ptr<Job>> jobs_;
 
     std::thread workThread_;
     std::atomic<bool> workerDone_;
     std::atomic<bool> shouldAbort_;
 
+    mutable std::mutex perfMutex_;
     float perfTotalTime_;
     float perfDecodingTime_;
     float perfEncodingTime_;
 
     double totalDuration_s_;
-    double rendered_s_;
-
-    struct SwsContext* pResizer_;
 
     std::chrono::high_resolution_clock::time_point tWorkerStart_;
 
-    std::string currentStep_;
-
     MediaEncoder::Timing lastVideoTiming_;
     MediaEncoder::Timing lastAudioTiming_;
 
     bool useHwDecoder_;
     bool useHwEncoder_;
+    bool smartRender_;
+    bool fanOut_;
+    bool segmentCache_;
+    bool sceneKeyframes_;
+    bool fragmented_;
+
+    std::mutex journalMutex_;
+
+    unsigned int cpuBudget_;
+    size_t memoryBudget_;
+
+    static constexpr size_t FRAME_QUEUE_SIZE = 8;
+
+    // rough cost of one job, software encoders use several cores each
+    static constexpr unsigned int SCOREBOARD_JOB_CPU = 2;
+    static constexpr unsigned int CUT_JOB_CPU = 8;
+    static constexpr unsigned int CUT_JOB_CPU_HW = 2;
+    static constexpr size_t SCOREBOARD_JOB_MEMORY = 128ULL*1024*1024;
+    static constexpr size_t CUT_JOB_MEMORY = 768ULL*1024*1024;
+    static constexpr size_t DEFAULT_MEMORY_BUDGET = 8192ULL*1024*1024;
+
+    // long outputs are encoded in segments of this length in parallel and concatenated afterwards
+    static constexpr double SEGMENT_DURATION_S = 600.0;
+    static constexpr unsigned int CONCAT_JOB_CPU = 1;
+    static constexpr unsigned int COPY_JOB_CPU = 1;
+    static constexpr size_t CONCAT_JOB_MEMORY = 128ULL*1024*1024;
+
+    // bump when encoder settings change in a way the cache key does not cover
+    static constexpr int SEGMENT_CACHE_VERSION = 1;
+
+    // written segments may be shorter than planned by the rounding to whole frames
+    static constexpr double JOURNAL_DURATION_TOLERANCE_S = 0.5;
+
+    // least recently used segments are removed beyond this size
+    static constexpr uintmax_t SEGMENT_CACHE_MAX_BYTES = 64ULL*1024*1024*1024;
 };
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+// Bounded lock-free queue for exactly one producer and one consumer thread.
+// push and pop never block, they fail if the queue is full or empty. The wait
+// variants sleep until the other side made room or added an item.
+template<typename T>
+class SpscQueue
+{
+public:
+    explicit SpscQueue(size_t capacity)
+    :slots_(capacity + 1),
+     head_(0),
+     tail_(0)
+    {
+    }
+
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    bool push(const T& item)
+    {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        const size_t next = increment(tail);
+
+        if(next == head_.load(std::memory_order_acquire))
+            return false;
+
+        slots_[tail] = item;
+        tail_.store(next, std::memory_order_release);
+
+        notify();
+
+        return true;
+    }
+
+    bool pop(T& item)
+    {
+        const size_t head = head_.load(std::memory_order_relaxed);
+
+        if(head == tail_.load(std::memory_order_acquire))
+            return false;
+
+        item = std::move(slots_[head]);
+        slots_[head] = T();
+        head_.store(increment(head), std::memory_order_release);
+
+        notify();
+
+        return true;
+    }
+
+    // stop is polled while waiting, the wait fails as soon as it returns true
+    template<typename Stop>
+    bool pushWait(const T& item, Stop stop)
+    {
+        while(!push(item))
+        {
+            if(stop())
+                return false;
+
+            wait([&]() { return size() < capacity(); });
+        }
+
+        return true;
+    }
+
+    template<typename Stop>
+    bool popWait(T& item, Stop stop)
+    {
+        while(!pop(item))
+        {
+            if(stop())
+                return false;
+
+            wait([&]() { return size() > 0; });
+        }
+
+        return true;
+    }
+
+    size_t size() const
+    {
+        const size_t head = head_.load(std::memory_order_acquire);
+        const size_t tail = tail_.load(std::memory_order_acquire);
+
+        return (tail + slots_.size() - head) % slots_.size();
+    }
+
+    size_t capacity() const { return slots_.size() - 1; }
+
+private:
+    size_t increment(size_t index) const { return (index + 1) % slots_.size(); }
+
+    template<typename Ready>
+    void wait(Ready ready)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        waiters_.fetch_add(1);
+        waitCv_.wait_for(lock, WAIT_INTERVAL, ready);
+        waiters_.fetch_sub(1);
+    }
+
+    void notify()
+    {
+        // pairs with the increment in wait, either the waiter sees the new index or we see the waiter
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if(waiters_.load(std::memory_order_relaxed) > 0)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            waitCv_.notify_all();
+        }
+    }
+
+    std::vector<T> slots_;
+
+    // producer and consumer side on separate cache lines
+    alignas(64) std::atomic<size_t> head_;
+    alignas(64) std::atomic<size_t> tail_;
+
+    // only used when one side has to wait
+    std::mutex mutex_;
+    std::condition_variable waitCv_;
+    std::atomic<int> waiters_ { 0 };
+
+    static constexpr std::chrono::milliseconds WAIT_INTERVAL { 10 };
+};
@@ -0,0 +1,50 @@
+#include "ThreadPool.hpp"
+
+ThreadPool::ThreadPool(unsigned int numThreads)
+:runWorkers_(true)
+{
+    if(numThreads == 0)
+        numThreads = 1;
+
+    for(unsigned int i = 0; i < numThreads; i++)
+        workers_.emplace_back(&ThreadPool::worker, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        runWorkers_ = false;
+    }
+
+    cv_.notify_all();
+
+    for(auto& worker : workers_)
+    {
+        if(worker.joinable())
+            worker.join();
+    }
+}
+
+void ThreadPool::worker()
+{
+    while(1)
+    {
+        std::function<void()> task;
+
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+
+            cv_.wait(lock, [&]() { return !runWorkers_ || !tasks_.empty(); });
+
+            // finish all queued tasks before shutting down
+            if(tasks_.empty())
+                return;
+
+            task = std::move(tasks_.front());
+            tasks_.pop_front();
+        }
+
+        task();
+    }
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <deque>
+#include <vector>
+#include <memory>
+
+class ThreadPool
+{
+public:
+    ThreadPool(unsigned int numThreads = std::thread::hardware_concurrency());
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t getNumThreads() const { return workers_.size(); }
+
+    template<typename F>
+    auto submit(F&& func) -> std::future<decltype(func())>
+    {
+        using Result = decltype(func());
+
+        auto pTask = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(func));
+        std::future<Result> future = pTask->get_future();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            tasks_.emplace_back([pTask]() { (*pTask)(); });
+        }
+
+        cv_.notify_one();
+
+        return future;
+    }
+
+private:
+    void worker();
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<std::function<void()>> tasks_;
+
+    std::vector<std::thread> workers_;
+    bool runWorkers_;
+};